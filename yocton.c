@@ -17,12 +17,11 @@
 //
 
 #include "yocton.h"
+#include "yocton_kernels.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
-#include <ctype.h>
-#include <errno.h>
 #include <inttypes.h>
 #include <limits.h>
 #include <string.h>
@@ -41,7 +40,8 @@
 
 struct yocton_buffer {
 	uint8_t *data;
-	size_t len;
+	// len is length of data; size is size of the allocated buffer.
+	size_t len, size;
 };
 
 enum token_type {
@@ -61,20 +61,70 @@ struct yocton_instream {
 	// buf is the input buffer containing last data read by callback.
 	// buf[buf_offset:buf_len] is still to read.
 	uint8_t *buf;
-	size_t buf_len, buf_size;
-	unsigned int buf_offset;
+	size_t buf_len, buf_size, buf_offset;
 	// string contains the last string token read.
 	struct yocton_buffer string;
-	size_t string_size;
 	// error_buf is non-empty if an error occurs during parsing.
 	char *error_buf;
 	int lineno;
 	int token_lineno;
+	// Whether the last run of spaces skipped included a comment.
+	int skipped_comment;
 	struct yocton_object *root;
+	// Resource limits set with yocton_set_limit(); zero means no limit.
+	size_t max_string_length, max_depth, max_properties;
+	size_t max_input_size, max_memory;
+	// Total bytes read from input and memory allocated so far.
+	size_t input_size, memory_used;
+	// Flags set with yocton_set_flags().
+	unsigned int flags;
+	// State for UTF-8 validation: number of continuation bytes still
+	// expected, and range that the next one must be in.
+	int utf8_remaining;
+	uint8_t utf8_lower, utf8_upper;
+	// CRC32C of all input consumed so far, and of input consumed since
+	// the start of the current top-level property.
+	uint32_t checksum, span_checksum;
+	// Callback set by yocton_prop_raw() to receive consumed input.
+	yocton_raw raw_callback;
+	void *raw_handle;
+	// buf[:consumed_offset] has already been included in the checksums
+	// and passed to raw_callback.
+	size_t consumed_offset;
+	// Implementations of the low-level kernels chosen for this CPU.
+	const struct yocton_kernels *kernels;
 };
 
 static const uint8_t utf8_bom[] = { 0xef, 0xbb, 0xbf };
 
+// Character classes. We use a fixed table rather than the <ctype.h>
+// functions, since those depend on the current locale.
+#define SYM  0x01  /* Valid in a bare (unquoted) symbol. */
+#define SPC  0x02  /* Whitespace. */
+#define HEX  0x04  /* Hexadecimal digit. */
+
+static const uint8_t char_classes[256] = {
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, SPC, SPC, SPC, SPC, SPC, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	SPC, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, SYM, 0, SYM, SYM, 0,
+	SYM|HEX, SYM|HEX, SYM|HEX, SYM|HEX, SYM|HEX, SYM|HEX, SYM|HEX, SYM|HEX,
+	SYM|HEX, SYM|HEX, 0, 0, 0, 0, 0, 0,
+	0, SYM|HEX, SYM|HEX, SYM|HEX, SYM|HEX, SYM|HEX, SYM|HEX, SYM,
+	SYM, SYM, SYM, SYM, SYM, SYM, SYM, SYM,
+	SYM, SYM, SYM, SYM, SYM, SYM, SYM, SYM,
+	SYM, SYM, SYM, 0, 0, 0, 0, SYM,
+	0, SYM|HEX, SYM|HEX, SYM|HEX, SYM|HEX, SYM|HEX, SYM|HEX, SYM,
+	SYM, SYM, SYM, SYM, SYM, SYM, SYM, SYM,
+	SYM, SYM, SYM, SYM, SYM, SYM, SYM, SYM,
+	SYM, SYM, SYM, 0, 0, 0, 0, 0,
+	// All bytes >= 0x80 have no class.
+};
+
+#define IS_CLASS(c, cls) ((char_classes[(uint8_t) (c)] & (cls)) != 0)
+
 static void input_error(struct yocton_instream *s, char *fmt, ...)
 {
 	va_list args;
@@ -98,26 +148,104 @@ static int assign_alloc(void *ptr, struct yocton_instream *s, void *result)
 	return 1;
 }
 
+// Account for memory about to be allocated by the parser, storing an
+// error if the memory limit would be exceeded.
+static int reserve_memory(struct yocton_instream *s, size_t size)
+{
+	if (s->max_memory != 0 && s->memory_used + size > s->max_memory) {
+		input_error(s, "memory limit of %lu bytes exceeded",
+		            (unsigned long) s->max_memory);
+		return 0;
+	}
+	s->memory_used += size;
+	return 1;
+}
+
+static void release_memory(struct yocton_instream *s, size_t size)
+{
+	s->memory_used -= size;
+}
+
+// As assign_alloc, for memory accounted for with reserve_memory. If the
+// allocation failed, the reserved memory is released again.
+static int assign_reserved(void *ptr, struct yocton_instream *s,
+                           void *result, size_t size)
+{
+	if (result == NULL) {
+		release_memory(s, size);
+	}
+	return assign_alloc(ptr, s, result);
+}
+
 static int buffer_dup(struct yocton_instream *s, struct yocton_buffer *to,
                       const struct yocton_buffer *from)
 {
+	CHECK_OR_RETURN(reserve_memory(s, from->len + 1), 0);
 	CHECK_OR_RETURN(
-	    assign_alloc(&to->data, s, malloc(from->len + 1)), 0);
+	    assign_reserved(&to->data, s, malloc(from->len + 1),
+	                    from->len + 1), 0);
 	memcpy(to->data, from->data, from->len);
 	to->data[from->len] = '\0';
 	to->len = from->len;
+	to->size = from->len + 1;
 	return 1;
 }
 
+// Add any input consumed since the last call to the running checksums,
+// and pass it to the raw callback if there is one.
+static void update_consumed(struct yocton_instream *s)
+{
+	size_t len = s->buf_offset - s->consumed_offset;
+
+	if (len == 0) {
+		return;
+	}
+	if ((s->flags & YOCTON_CHECKSUM) != 0) {
+		s->checksum = s->kernels->crc32c(
+		    s->checksum, s->buf + s->consumed_offset, len);
+		s->span_checksum = s->kernels->crc32c(
+		    s->span_checksum, s->buf + s->consumed_offset, len);
+	}
+	if (s->raw_callback != NULL) {
+		s->raw_callback(s->buf + s->consumed_offset, len,
+		                s->raw_handle);
+	}
+	s->consumed_offset = s->buf_offset;
+}
+
+static int input_size_exceeded(struct yocton_instream *s)
+{
+	input_error(s, "input exceeds maximum size of %lu bytes",
+	            (unsigned long) s->max_input_size);
+	s->buf_len = 0;
+	return 0;
+}
+
 static int peek_next_byte(struct yocton_instream *s, uint8_t *c)
 {
 	if (s->buf_offset >= s->buf_len) {
+		update_consumed(s);
+		// Input beyond the limit is cut off below, so that the error
+		// is reported at the line where the limit is exceeded.
+		if (s->max_input_size != 0
+		 && s->input_size > s->max_input_size) {
+			return input_size_exceeded(s);
+		}
 		s->buf_len = s->callback(s->buf, s->buf_size,
 		                         s->callback_handle);
 		if (s->buf_len == 0) {
 			return 0;
 		}
 		s->buf_offset = 0;
+		s->consumed_offset = 0;
+		s->input_size += s->buf_len;
+		if (s->max_input_size != 0
+		 && s->input_size > s->max_input_size) {
+			s->buf_len -= s->input_size - s->max_input_size;
+			if (s->buf_len == 0) {
+				return input_size_exceeded(s);
+			}
+		}
 	}
 	*c = s->buf[s->buf_offset];
 	return 1;
@@ -139,25 +267,118 @@ static int read_next_byte(struct yocton_instream *s, uint8_t *c)
 
 static int is_symbol_byte(int c)
 {
-	return isalnum(c) || strchr("_-+.", c) != NULL;
+	return IS_CLASS(c, SYM);
+}
+
+static uint8_t hex_value(uint8_t c)
+{
+	if (c >= 'a') {
+		return c - 'a' + 10;
+	} else if (c >= 'A') {
+		return c - 'A' + 10;
+	} else {
+		return c - '0';
+	}
+}
+
+// Check the next byte of a string is valid UTF-8. The ranges here are
+// from the table of well-formed byte sequences in the Unicode standard,
+// which excludes overlong encodings and surrogates.
+static int validate_utf8_byte(struct yocton_instream *s, uint8_t c)
+{
+	if (s->utf8_remaining > 0) {
+		if (c < s->utf8_lower || c > s->utf8_upper) {
+			return 0;
+		}
+		--s->utf8_remaining;
+		s->utf8_lower = 0x80;
+		s->utf8_upper = 0xbf;
+		return 1;
+	} else if (c < 0x80) {
+		return 1;
+	}
+	s->utf8_lower = 0x80;
+	s->utf8_upper = 0xbf;
+	if (c >= 0xc2 && c <= 0xdf) {
+		s->utf8_remaining = 1;
+	} else if (c >= 0xe0 && c <= 0xef) {
+		s->utf8_remaining = 2;
+		if (c == 0xe0) {
+			s->utf8_lower = 0xa0;
+		} else if (c == 0xed) {
+			s->utf8_upper = 0x9f;
+		}
+	} else if (c >= 0xf0 && c <= 0xf4) {
+		s->utf8_remaining = 3;
+		if (c == 0xf0) {
+			s->utf8_lower = 0x90;
+		} else if (c == 0xf4) {
+			s->utf8_upper = 0x8f;
+		}
+	} else {
+		return 0;
+	}
+	return 1;
 }
 
 static int append_string_byte(struct yocton_instream *s, uint8_t c)
 {
-	if (s->string.len + 1 >= s->string_size) {
-		s->string_size = s->string_size == 0 ? 64 : s->string_size * 2;
+	size_t new_size;
+
+	if (s->max_string_length != 0
+	 && s->string.len >= s->max_string_length) {
+		input_error(s, "string exceeds maximum length of %lu bytes",
+		            (unsigned long) s->max_string_length);
+		return 0;
+	}
+	if (s->string.len + 1 >= s->string.size) {
+		new_size = s->string.size == 0 ? 64 : s->string.size * 2;
 		CHECK_OR_RETURN(
-		    assign_alloc(&s->string.data, s,
-		        realloc(s->string.data, s->string_size)), 0);
+		    reserve_memory(s, new_size - s->string.size), 0);
+		CHECK_OR_RETURN(
+		    assign_reserved(&s->string.data, s,
+		        realloc(s->string.data, new_size),
+		        new_size - s->string.size), 0);
+		s->string.size = new_size;
 	}
 	s->string.data[s->string.len] = c;
 	++s->string.len;
 	return 1;
 }
 
+// Append a run of bytes to the string buffer in one go.
+static int append_string_bytes(struct yocton_instream *s, const uint8_t *data,
+                               size_t len)
+{
+	size_t new_size;
+
+	if (s->max_string_length != 0
+	 && s->string.len + len > s->max_string_length) {
+		input_error(s, "string exceeds maximum length of %lu bytes",
+		            (unsigned long) s->max_string_length);
+		return 0;
+	}
+	if (s->string.len + len >= s->string.size) {
+		new_size = s->string.size == 0 ? 64 : s->string.size * 2;
+		while (s->string.len + len >= new_size) {
+			new_size *= 2;
+		}
+		CHECK_OR_RETURN(
+		    reserve_memory(s, new_size - s->string.size), 0);
+		CHECK_OR_RETURN(
+		    assign_reserved(&s->string.data, s,
+		        realloc(s->string.data, new_size),
+		        new_size - s->string.size), 0);
+		s->string.size = new_size;
+	}
+	memcpy(s->string.data + s->string.len, data, len);
+	s->string.len += len;
+	return 1;
+}
+
 static int read_escape_sequence(struct yocton_instream *s, uint8_t *c)
 {
-	uint8_t xcs[3];
+	uint8_t xcs[2];
 	CHECK_OR_RETURN(read_next_byte(s, c), 0);
 	switch (*c) {
 		case 'n':  *c = '\n'; return 1;
@@ -165,14 +386,15 @@ static int read_escape_sequence(struct yocton_instream *s, uint8_t *c)
 		case '\\': *c = '\\'; return 1;
 		case '"':  *c = '\"'; return 1;
 		case 'x':
-			if (!read_next_byte(s, &xcs[0]) || !isxdigit(xcs[0])
-			 || !read_next_byte(s, &xcs[1]) || !isxdigit(xcs[1])) {
+			if (!read_next_byte(s, &xcs[0])
+			 || !IS_CLASS(xcs[0], HEX)
+			 || !read_next_byte(s, &xcs[1])
+			 || !IS_CLASS(xcs[1], HEX)) {
 				input_error(s, "\\x sequence must be followed "
 				            "by two hexadecimal characters");
 				return 0;
 			}
-			xcs[2] = '\0';
-			*c = (uint8_t) strtoul((const char *) xcs, NULL, 16);
+			*c = (hex_value(xcs[0]) << 4) | hex_value(xcs[1]);
 			if (*c == 0) {
 				input_error(s, "NUL byte not allowed in "
 				            "\\x escape sequence.");
@@ -198,9 +420,11 @@ static enum token_type skip_past_spaces(struct yocton_instream *s, uint8_t *c)
 {
 	uint8_t c2, c3;
 
+	s->skipped_comment = 0;
 	// Skip past any spaces. Reaching EOF is not always an error.
 	while (peek_next_byte(s, c)) {
 		if (*c == '/') {
+			s->skipped_comment = 1;
 			// Skip past comment.
 			CHECK_OR_RETURN(
 			    read_next_byte(s, c) && *c == '/'
@@ -216,7 +440,7 @@ static enum token_type skip_past_spaces(struct yocton_instream *s, uint8_t *c)
 			 && read_next_byte(s, &c2) && c2 == utf8_bom[1]
 			 && read_next_byte(s, &c3) && c3 == utf8_bom[2],
 			    TOKEN_ERROR);
-		} else if (isspace(*c)) {
+		} else if (IS_CLASS(*c, SPC)) {
 			CHECK_OR_RETURN(read_next_byte(s, c), TOKEN_ERROR);
 		} else {
 			return TOKEN_NONE;
@@ -256,28 +480,70 @@ static enum token_type next_string_chunk(struct yocton_instream *s)
 	return TOKEN_NONE;
 }
 
-// Read quote-delimited "C style" string.
-static enum token_type read_string(struct yocton_instream *s)
+// Read the next byte of a quote-delimited "C style" string, after the
+// opening quote has been read. Returns TOKEN_NONE if a byte was read, or
+// TOKEN_STRING once the end of the string is reached.
+static enum token_type read_string_byte(struct yocton_instream *s,
+                                        uint8_t *c)
 {
-	uint8_t c;
-	s->string.len = 0;
 	for (;;) {
-		CHECK_OR_RETURN(read_next_byte(s, &c), TOKEN_ERROR);
-		if (c == '"') {
+		CHECK_OR_RETURN(read_next_byte(s, c), TOKEN_ERROR);
+		if ((s->flags & YOCTON_VALIDATE_UTF8) != 0
+		 && !validate_utf8_byte(s, *c)) {
+			input_error(s, "invalid UTF-8 sequence in string");
+			return TOKEN_ERROR;
+		}
+		if (*c == '"') {
 			enum token_type tt = next_string_chunk(s);
 			if (tt != TOKEN_NONE) {
 				return tt;
 			}
 			continue;
-		} else if (c == '\\') {
-			if (!read_escape_sequence(s, &c)) {
+		} else if (*c == '\\') {
+			if (!read_escape_sequence(s, c)) {
 				return TOKEN_ERROR;
 			}
-		} else if (c < 0x20) {
+		} else if (*c < 0x20) {
 			input_error(s, "control character not allowed inside "
-			            "string (ASCII char 0x%02x)", c);
+			            "string (ASCII char 0x%02x)", *c);
 			return TOKEN_ERROR;
 		}
+		return TOKEN_NONE;
+	}
+}
+
+// Returns the number of bytes at the current position in the input buffer
+// that can be taken as part of a quoted string without any processing.
+// Anything else (escapes, the closing quote, errors, and non-ASCII bytes
+// when validating UTF-8) is left to read_string_byte.
+static size_t plain_string_bytes(struct yocton_instream *s)
+{
+	if (s->utf8_remaining > 0 || s->buf_offset >= s->buf_len) {
+		return 0;
+	}
+	return s->kernels->string_span(
+	    s->buf + s->buf_offset, s->buf_len - s->buf_offset,
+	    (s->flags & YOCTON_VALIDATE_UTF8) != 0);
+}
+
+// Read quote-delimited "C style" string.
+static enum token_type read_string(struct yocton_instream *s)
+{
+	enum token_type tt;
+	size_t len;
+	uint8_t c;
+
+	s->string.len = 0;
+	for (;;) {
+		len = plain_string_bytes(s);
+		CHECK_OR_RETURN(
+		    append_string_bytes(s, s->buf + s->buf_offset, len),
+		    TOKEN_ERROR);
+		s->buf_offset += len;
+		tt = read_string_byte(s, &c);
+		if (tt != TOKEN_NONE) {
+			return tt;
+		}
 		CHECK_OR_RETURN(append_string_byte(s, c), TOKEN_ERROR);
 	}
 }
@@ -333,26 +599,56 @@ struct yocton_object {
 	struct yocton_instream *instream;
 	struct yocton_prop *property;
 	int done;
+	// Nesting depth (top level is zero) and properties read so far.
+	size_t depth, num_properties;
+};
+
+enum value_state {
+	// Value has been read into the value buffer.
+	VALUE_READ,
+	// Value is a quoted string that has not been read from input yet.
+	VALUE_PENDING,
+	// Value is being read by yocton_prop_value_read().
+	VALUE_STREAMING,
+	// Value was read by yocton_prop_value_read() and is not available.
+	VALUE_STREAMED,
 };
 
 struct yocton_prop {
 	enum yocton_prop_type type;
 	struct yocton_buffer name, value;
 	struct yocton_object *parent, *child;
+	enum value_state value_state;
+	// Whether the value is a quoted string, rather than a bare one.
+	int quoted;
+	// Offset into value buffer for yocton_prop_value_read().
+	size_t value_offset;
 };
 
 static void free_obj(struct yocton_object *obj);
 
+static void free_buffer(struct yocton_instream *s, struct yocton_buffer *b)
+{
+	if (b->data != NULL) {
+		release_memory(s, b->size);
+		free(b->data);
+	}
+}
+
 static void free_property(struct yocton_prop *property)
 {
+	struct yocton_instream *s;
+
 	if (property == NULL) {
 		return;
 	}
+	s = property->parent->instream;
 	free_obj(property->child);
 	property->child = NULL;
 
-	free(property->name.data);
-	free(property->value.data);
+	free_buffer(s, &property->name);
+	free_buffer(s, &property->value);
+	release_memory(s, sizeof(struct yocton_prop));
 	free(property);
 }
 
@@ -363,6 +659,9 @@ static void free_obj(struct yocton_object *obj)
 	}
 	free_property(obj->property);
 	obj->property = NULL;
+	if (obj->instream != NULL) {
+		release_memory(obj->instream, sizeof(struct yocton_object));
+	}
 	free(obj);
 }
 
@@ -388,8 +687,10 @@ static int init_instream(struct yocton_instream *instream)
 	instream->buf =
 	    (uint8_t *) calloc(instream->buf_size, sizeof(uint8_t));
 	CHECK_OR_RETURN(instream->buf != NULL, 0);
-	instream->string_size = 0;
+	instream->string.size = 0;
 	instream->string.data = NULL;
+	instream->memory_used = sizeof(struct yocton_instream)
+	                      + ERROR_BUF_SIZE + instream->buf_size;
 
 	return 1;
 }
@@ -409,6 +710,7 @@ static struct yocton_instream *new_instream(yocton_read callback, void *handle)
 
 	instream->callback = callback;
 	instream->callback_handle = handle;
+	instream->kernels = __yocton_kernels(0);
 	return instream;
 }
 
@@ -438,6 +740,7 @@ struct yocton_object *yocton_read_with(yocton_read callback, void *handle)
 	obj->property = NULL;
 	obj->done = 0;
 	obj->instream->root = obj;
+	obj->instream->memory_used += sizeof(struct yocton_object);
 
 	return obj;
 }
@@ -475,21 +778,143 @@ void yocton_check(struct yocton_object *obj, const char *error_msg,
 	}
 }
 
+void yocton_set_limit(struct yocton_object *obj, enum yocton_limit limit,
+                      size_t value)
+{
+	struct yocton_instream *s = obj->instream;
+
+	switch (limit) {
+		case YOCTON_LIMIT_STRING_LENGTH:
+			s->max_string_length = value;
+			break;
+		case YOCTON_LIMIT_DEPTH:
+			s->max_depth = value;
+			break;
+		case YOCTON_LIMIT_PROPERTIES:
+			s->max_properties = value;
+			break;
+		case YOCTON_LIMIT_INPUT_SIZE:
+			s->max_input_size = value;
+			break;
+		case YOCTON_LIMIT_MEMORY:
+			s->max_memory = value;
+			break;
+	}
+}
+
+void yocton_set_flags(struct yocton_object *obj, unsigned int flags)
+{
+	update_consumed(obj->instream);
+	obj->instream->flags = flags;
+	obj->instream->kernels =
+	    __yocton_kernels((flags & YOCTON_FORCE_SCALAR) != 0);
+}
+
+void yocton_set_buffer_size(struct yocton_object *obj, size_t size)
+{
+	struct yocton_instream *s = obj->instream;
+	size_t remaining;
+	uint8_t *new_buf;
+
+	update_consumed(s);
+	remaining = s->buf_len - s->buf_offset;
+	if (size == 0 || size < remaining) {
+		return;
+	}
+	// Move any input still to be parsed to the start of the buffer.
+	memmove(s->buf, s->buf + s->buf_offset, remaining);
+	s->buf_len = remaining;
+	s->buf_offset = 0;
+	s->consumed_offset = 0;
+
+	if (size > s->buf_size && !reserve_memory(s, size - s->buf_size)) {
+		return;
+	}
+	new_buf = (uint8_t *) realloc(s->buf, size);
+	if (!assign_alloc(&s->buf, s, new_buf)) {
+		if (size > s->buf_size) {
+			release_memory(s, size - s->buf_size);
+		}
+		return;
+	}
+	if (size < s->buf_size) {
+		release_memory(s, s->buf_size - size);
+	}
+	s->buf_size = size;
+}
+
+uint32_t yocton_checksum(struct yocton_object *obj)
+{
+	update_consumed(obj->instream);
+	return obj->instream->checksum;
+}
+
 void yocton_free(struct yocton_object *obj)
 {
-	if (obj != obj->instream->root) {
+	struct yocton_instream *instream = obj->instream;
+
+	if (obj != instream->root) {
 		return;
 	}
 
-	free_instream(obj->instream);
 	free_obj(obj);
+	free_instream(instream);
+}
+
+// Read a quoted string value that has not been read yet. The string is
+// moved into the property's value buffer.
+static int read_pending_value(struct yocton_prop *p)
+{
+	struct yocton_instream *s = p->parent->instream;
+
+	if (p->value_state != VALUE_PENDING) {
+		return 1;
+	}
+	if (read_string(s) != TOKEN_STRING) {
+		input_error(s, "string expected to follow ':'");
+		return 0;
+	}
+	// Rather than making a copy, we take ownership of the string buffer.
+	// There is always space for the terminating NUL.
+	if (s->string.data == NULL) {
+		CHECK_OR_RETURN(append_string_byte(s, '\0'), 0);
+		s->string.len = 0;
+	}
+	s->string.data[s->string.len] = '\0';
+	p->value = s->string;
+	p->value_state = VALUE_READ;
+	s->string.data = NULL;
+	s->string.len = 0;
+	s->string.size = 0;
+	return 1;
+}
+
+// Skip past the rest of a string value that is still to be read.
+static void skip_value(struct yocton_prop *p)
+{
+	struct yocton_instream *s = p->parent->instream;
+	enum token_type tt;
+	uint8_t c;
+
+	if (p->value_state == VALUE_PENDING
+	 || p->value_state == VALUE_STREAMING) {
+		do {
+			s->buf_offset += plain_string_bytes(s);
+			tt = read_string_byte(s, &c);
+		} while (tt == TOKEN_NONE);
+		p->value_state = VALUE_STREAMED;
+	}
 }
 
 // If we're partway through reading a child object, skip through any
-// of its properties so we can read the next of ours.
+// of its properties so we can read the next of ours. Similarly, skip past
+// any string value that has not been read yet.
 static void skip_forward(struct yocton_object *obj)
 {
 	struct yocton_object *child;
+	if (obj->property != NULL) {
+		skip_value(obj->property);
+	}
 	if (obj->property == NULL || obj->property->child == NULL) {
 		return;
 	}
@@ -503,13 +928,28 @@ static void skip_forward(struct yocton_object *obj)
 
 static int parse_next_prop(struct yocton_object *obj, struct yocton_prop *p)
 {
-	switch (read_next_token(obj->instream)) {
+	struct yocton_instream *s = obj->instream;
+	enum token_type tt;
+	uint8_t c;
+
+	switch (read_next_token(s)) {
 		case TOKEN_COLON:
 			// This is the string:string case.
 			p->type = YOCTON_PROP_STRING;
-			if (read_next_token(obj->instream) != TOKEN_STRING) {
-				input_error(obj->instream, "string expected "
-				            "to follow ':'");
+			// Quoted strings are only read once the value is
+			// requested, so that they can be streamed.
+			tt = skip_past_spaces(s, &c);
+			if (tt == TOKEN_NONE && c == '"') {
+				CHECK_OR_RETURN(read_next_byte(s, &c), 0);
+				s->token_lineno = s->lineno;
+				p->value_state = VALUE_PENDING;
+				p->quoted = 1;
+				return 1;
+			}
+			if (tt != TOKEN_NONE
+			 || read_next_token(s) != TOKEN_STRING) {
+				s->token_lineno = s->lineno;
+				input_error(s, "string expected to follow ':'");
 				return 0;
 			}
 			CHECK_OR_RETURN(
@@ -518,11 +958,23 @@ static int parse_next_prop(struct yocton_object *obj, struct yocton_prop *p)
 			return 1;
 		case TOKEN_OPEN_BRACE:
 			p->type = YOCTON_PROP_OBJECT;
+			if (obj->instream->max_depth != 0
+			 && obj->depth >= obj->instream->max_depth) {
+				input_error(obj->instream, "maximum nesting "
+				            "depth of %lu exceeded", (unsigned long)
+				            obj->instream->max_depth);
+				return 0;
+			}
+			CHECK_OR_RETURN(
+			    reserve_memory(obj->instream,
+			                   sizeof(struct yocton_object)), 0);
 			CHECK_OR_RETURN(
-			    assign_alloc(&p->child, obj->instream,
-			        calloc(1, sizeof(struct yocton_object))), 0);
+			    assign_reserved(&p->child, obj->instream,
+			        calloc(1, sizeof(struct yocton_object)),
+			        sizeof(struct yocton_object)), 0);
 			p->child->instream = obj->instream;
 			p->child->done = 0;
+			p->child->depth = obj->depth + 1;
 			return 1;
 		default:
 			input_error(obj->instream, "':' or '{' expected to "
@@ -535,9 +987,20 @@ static struct yocton_prop *next_prop(struct yocton_object *obj)
 {
 	struct yocton_prop *p = NULL;
 
+	if (obj->instream->max_properties != 0
+	 && obj->num_properties >= obj->instream->max_properties) {
+		input_error(obj->instream, "object has more than %lu "
+		            "properties", (unsigned long)
+		            obj->instream->max_properties);
+		return NULL;
+	}
+	++obj->num_properties;
 	CHECK_OR_RETURN(
-	    assign_alloc(&p, obj->instream,
-	        calloc(1, sizeof(struct yocton_prop))), NULL);
+	    reserve_memory(obj->instream, sizeof(struct yocton_prop)), NULL);
+	CHECK_OR_RETURN(
+	    assign_reserved(&p, obj->instream,
+	        calloc(1, sizeof(struct yocton_prop)),
+	        sizeof(struct yocton_prop)), NULL);
 	obj->property = p;
 	p->parent = obj;
 
@@ -561,6 +1024,12 @@ struct yocton_prop *yocton_next_prop(struct yocton_object *obj)
 	free_property(obj->property);
 	obj->property = NULL;
 
+	// Start of a new top-level property span for yocton_prop_checksum.
+	if (obj == obj->instream->root) {
+		update_consumed(obj->instream);
+		obj->instream->span_checksum = 0;
+	}
+
 	switch (read_next_token(obj->instream)) {
 		case TOKEN_STRING:
 			return next_prop(obj);
@@ -604,9 +1073,69 @@ const char *yocton_prop_value(struct yocton_prop *p)
 		            "not string type", p->name.data);
 		return "";
 	}
+	if (p->value_state == VALUE_STREAMING
+	 || p->value_state == VALUE_STREAMED) {
+		input_error(p->parent->instream, "property '%s': value "
+		            "already read by yocton_prop_value_read",
+		            p->name.data);
+		return "";
+	}
+	if (!read_pending_value(p)) {
+		return "";
+	}
 	return (const char *) p->value.data;
 }
 
+size_t yocton_prop_value_read(struct yocton_prop *p, void *buf,
+                              size_t buf_size)
+{
+	struct yocton_instream *s = p->parent->instream;
+	uint8_t *out = (uint8_t *) buf;
+	enum token_type tt;
+	size_t result = 0, len;
+
+	if (p->type != YOCTON_PROP_STRING) {
+		input_error(s, "property '%s' has object, not string type",
+		            p->name.data);
+		return 0;
+	}
+	switch (p->value_state) {
+		case VALUE_READ:
+			// Value has already been read into memory.
+			result = p->value.len - p->value_offset;
+			if (result > buf_size) {
+				result = buf_size;
+			}
+			memcpy(out, p->value.data + p->value_offset, result);
+			p->value_offset += result;
+			return result;
+		case VALUE_PENDING:
+		case VALUE_STREAMING:
+			p->value_state = VALUE_STREAMING;
+			while (result < buf_size) {
+				len = plain_string_bytes(s);
+				if (len > buf_size - result) {
+					len = buf_size - result;
+				}
+				memcpy(out + result, s->buf + s->buf_offset, len);
+				s->buf_offset += len;
+				result += len;
+				if (result >= buf_size) {
+					break;
+				}
+				tt = read_string_byte(s, &out[result]);
+				if (tt != TOKEN_NONE) {
+					p->value_state = VALUE_STREAMED;
+					break;
+				}
+				++result;
+			}
+			return result;
+		default:
+			return 0;
+	}
+}
+
 char *yocton_prop_value_dup(struct yocton_prop *p)
 {
 	const char *value = yocton_prop_value(p);
@@ -619,6 +1148,75 @@ char *yocton_prop_value_dup(struct yocton_prop *p)
 	return result;
 }
 
+uint32_t yocton_prop_checksum(struct yocton_prop *p)
+{
+	struct yocton_instream *s = p->parent->instream;
+
+	if (p->parent != s->root) {
+		input_error(s, "property '%s': checksum is only available for "
+		            "top-level properties", p->name.data);
+		return 0;
+	}
+	// Make sure we have read to the end of the property.
+	if (p->type == YOCTON_PROP_STRING) {
+		read_pending_value(p);
+		skip_value(p);
+	} else {
+		while (yocton_next_prop(p->child) != NULL);
+	}
+	update_consumed(s);
+	return s->span_checksum;
+}
+
+void yocton_prop_raw(struct yocton_prop *p, yocton_raw callback,
+                     void *handle)
+{
+	struct yocton_instream *s = p->parent->instream;
+
+	if (p->type == YOCTON_PROP_STRING && !p->quoted) {
+		// Bare strings are the same in the input as in the value.
+		callback(p->value.data, p->value.len, handle);
+		return;
+	} else if (p->type == YOCTON_PROP_STRING
+	        && p->value_state != VALUE_PENDING) {
+		input_error(s, "property '%s': value already read",
+		            p->name.data);
+		return;
+	} else if (p->type == YOCTON_PROP_OBJECT
+	        && (p->child->num_properties > 0 || p->child->done)) {
+		input_error(s, "property '%s': object already read",
+		            p->name.data);
+		return;
+	}
+	update_consumed(s);
+	s->raw_callback = callback;
+	s->raw_handle = handle;
+	if (p->type == YOCTON_PROP_STRING) {
+		// The opening quote has already been consumed.
+		callback("\"", 1, handle);
+		skip_value(p);
+	} else {
+		while (yocton_next_prop(p->child) != NULL);
+	}
+	update_consumed(s);
+	s->raw_callback = NULL;
+	s->raw_handle = NULL;
+}
+
+size_t __yocton_prop_depth(struct yocton_prop *p)
+{
+	return p->parent->depth;
+}
+
+int __yocton_prop_ends_in_comment(struct yocton_prop *p)
+{
+	// The input text of a quoted string runs up to the next token, so
+	// the spaces skipped last are the ones at the end of it. Bare strings
+	// have no trailing text, and an object's text ends with '}'.
+	return p->type == YOCTON_PROP_STRING && p->quoted
+	    && p->parent->instream->skipped_comment;
+}
+
 struct yocton_object *yocton_prop_inner(struct yocton_prop *p)
 {
 	if (p->type != YOCTON_PROP_OBJECT) {
@@ -629,48 +1227,76 @@ struct yocton_object *yocton_prop_inner(struct yocton_prop *p)
 	return p->child;
 }
 
+// Parse a decimal integer with an optional leading sign. We do this
+// ourselves rather than using strtoll(), which depends on the locale.
+// Returns zero if the value is not a valid integer; if the value is valid
+// but too large to be represented, *overflow is set.
+static int parse_decimal(const char *value, int *negative,
+                         unsigned long long *magnitude, int *overflow)
+{
+	unsigned long long result = 0, digit;
+	const char *c = value;
+
+	*negative = *c == '-';
+	if (*c == '-' || *c == '+') {
+		++c;
+	}
+	// Must be entire string, not empty, nothing leading or trailing:
+	if (*c == '\0') {
+		return 0;
+	}
+	*overflow = 0;
+	for (; *c != '\0'; ++c) {
+		if (*c < '0' || *c > '9') {
+			return 0;
+		}
+		digit = *c - '0';
+		if (result > (ULLONG_MAX - digit) / 10) {
+			*overflow = 1;
+		}
+		result = result * 10 + digit;
+	}
+	*magnitude = result;
+	return 1;
+}
+
 signed long long yocton_prop_int(struct yocton_prop *p, size_t n)
 {
-	signed long long result, min, max;
+	unsigned long long magnitude, max;
 	const char *value;
-	char *endptr;
+	int negative, overflow;
 
 	if (n == 0 || n > sizeof(long long)) {
 		input_error(p->parent->instream, "unsupported "
 		            "integer size: %d-bit", n * 8);
 		return 0;
-	} else if (n == sizeof(long long)) {
-		min = LLONG_MIN;
-		max = LLONG_MAX;
-	} else {
-		min = -(1ULL << (n * 8 - 1));
-		max = -min - 1;
 	}
 
 	value = yocton_prop_value(p);
-	errno = 0;
-	result = strtoll(value, &endptr, 10);
-	// Must be entire string, not empty, nothing leading or trailing:
-	if (*value == '\0' || isspace(*value) || *endptr != '\0') {
+	if (!parse_decimal(value, &negative, &magnitude, &overflow)) {
 		input_error(p->parent->instream, "not a valid integer "
 		            "value: '%s'", value);
 		return 0;
 	}
 
-	if (((result == LLONG_MIN || result == LLONG_MAX) && errno == ERANGE)
-	 || result < min || result > max) {
+	// Negative range is one larger than positive range.
+	max = (1ULL << (n * 8 - 1)) - 1 + negative;
+	if (overflow || magnitude > max) {
 		input_error(p->parent->instream, "value not in range of a "
 		            "%d-bit signed integer: %s", n * 8, value);
 		return 0;
 	}
-	return result;
+	if (negative && magnitude > 0) {
+		return -(signed long long) (magnitude - 1) - 1;
+	}
+	return (signed long long) magnitude;
 }
 
 unsigned long long yocton_prop_uint(struct yocton_prop *p, size_t n)
 {
-	unsigned long long result, max;
+	unsigned long long magnitude, max;
 	const char *value;
-	char *endptr;
+	int negative, overflow;
 
 	if (n == 0 || n > sizeof(unsigned long long)) {
 		input_error(p->parent->instream, "unsupported "
@@ -683,20 +1309,169 @@ unsigned long long yocton_prop_uint(struct yocton_prop *p, size_t n)
 	}
 
 	value = yocton_prop_value(p);
-	errno = 0;
-	result = strtoull(value, &endptr, 10);
-	if (*value == '\0' || isspace(*value) || *endptr != '\0') {
+	if (!parse_decimal(value, &negative, &magnitude, &overflow)) {
 		input_error(p->parent->instream, "not a valid integer "
 		            "value: '%s'", value);
 		return 0;
 	}
 
-	if ((result == ULLONG_MAX && errno == ERANGE) || result > max) {
+	if (overflow || magnitude > max || (negative && magnitude > 0)) {
 		input_error(p->parent->instream, "value not in range of a "
 		            "%d-bit unsigned integer: %s", n * 8, value);
 		return 0;
 	}
-	return result;
+	return magnitude;
+}
+
+// Values of base64 characters, plus one; zero means an invalid character.
+static const uint8_t base64_values[256] = {
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 63,  0,  0,  0, 64,
+	53, 54, 55, 56, 57, 58, 59, 60, 61, 62,  0,  0,  0,  0,  0,  0,
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,
+	16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26,  0,  0,  0,  0,  0,
+	 0, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41,
+	42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52,  0,  0,  0,  0,  0,
+	// All bytes >= 0x80 are invalid.
+};
+
+struct base64_decoder {
+	uint8_t *data;
+	size_t len, size;
+	// Value of partially decoded group of four characters, and number
+	// of characters (and padding characters) in it so far.
+	uint32_t group;
+	int group_len, padding;
+};
+
+static int base64_decode(struct base64_decoder *d, const uint8_t *in,
+                         size_t in_len)
+{
+	uint8_t *out = d->data + d->len;
+	uint32_t v;
+	size_t i = 0;
+
+	for (;;) {
+		// Fast path that decodes a whole group at once:
+		while (d->group_len == 0 && i + 4 <= in_len
+		    && base64_values[in[i]] != 0
+		    && base64_values[in[i + 1]] != 0
+		    && base64_values[in[i + 2]] != 0
+		    && base64_values[in[i + 3]] != 0) {
+			v = ((uint32_t) (base64_values[in[i]] - 1) << 18)
+			  | ((uint32_t) (base64_values[in[i + 1]] - 1) << 12)
+			  | ((uint32_t) (base64_values[in[i + 2]] - 1) << 6)
+			  | (uint32_t) (base64_values[in[i + 3]] - 1);
+			out[0] = (uint8_t) (v >> 16);
+			out[1] = (uint8_t) (v >> 8);
+			out[2] = (uint8_t) v;
+			out += 3;
+			i += 4;
+		}
+		if (i >= in_len) {
+			break;
+		}
+		// Slow path, one character at a time:
+		if (in[i] == '=' && d->group_len >= 2
+		 && d->group_len + d->padding < 4) {
+			++d->padding;
+		} else if (base64_values[in[i]] == 0 || d->padding > 0) {
+			return 0;
+		} else {
+			d->group = (d->group << 6) | (base64_values[in[i]] - 1);
+			++d->group_len;
+			if (d->group_len == 4) {
+				out[0] = (uint8_t) (d->group >> 16);
+				out[1] = (uint8_t) (d->group >> 8);
+				out[2] = (uint8_t) d->group;
+				out += 3;
+				d->group_len = 0;
+			}
+		}
+		++i;
+	}
+	d->len = out - d->data;
+	return 1;
+}
+
+// Decode the final partial group at the end of the data.
+static int base64_finish(struct base64_decoder *d)
+{
+	if (d->padding > 0 && d->group_len + d->padding != 4) {
+		return 0;
+	}
+	switch (d->group_len) {
+		case 0:
+			return 1;
+		case 2:
+			d->data[d->len] = (uint8_t) (d->group >> 4);
+			d->len += 1;
+			return 1;
+		case 3:
+			d->data[d->len] = (uint8_t) (d->group >> 10);
+			d->data[d->len + 1] = (uint8_t) (d->group >> 2);
+			d->len += 2;
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+void *yocton_prop_base64(struct yocton_prop *p, size_t *len)
+{
+	struct yocton_instream *s = p->parent->instream;
+	struct base64_decoder d = {NULL, 0, 0, 0, 0, 0};
+	uint8_t buf[256], *new_data;
+	size_t nbytes, new_size;
+
+	*len = 0;
+	if (p->value_state == VALUE_STREAMING
+	 || p->value_state == VALUE_STREAMED || p->value_offset > 0) {
+		input_error(s, "property '%s': value already read by "
+		            "yocton_prop_value_read", p->name.data);
+		return NULL;
+	}
+	for (;;) {
+		// The value is streamed so we never hold the encoded form of
+		// the whole value in memory.
+		nbytes = yocton_prop_value_read(p, buf, sizeof(buf));
+		if (nbytes == 0) {
+			break;
+		}
+		new_size = d.size == 0 ? sizeof(buf) : d.size;
+		while (new_size < d.len + (nbytes / 4 + 1) * 3) {
+			new_size *= 2;
+		}
+		if (new_size != d.size) {
+			new_data = (uint8_t *) realloc(d.data, new_size);
+			if (new_data == NULL) {
+				input_error(s, ERROR_ALLOC);
+				break;
+			}
+			d.data = new_data;
+			d.size = new_size;
+		}
+		if (!base64_decode(&d, buf, nbytes)) {
+			input_error(s, "property '%s': invalid base64 data",
+			            p->name.data);
+			break;
+		}
+	}
+	if (strlen(s->error_buf) == 0 && d.data == NULL) {
+		// Empty value.
+		assign_alloc(&d.data, s, malloc(1));
+	}
+	if (strlen(s->error_buf) == 0 && !base64_finish(&d)) {
+		input_error(s, "property '%s': invalid base64 data",
+		            p->name.data);
+	}
+	if (strlen(s->error_buf) > 0) {
+		free(d.data);
+		return NULL;
+	}
+	*len = d.len;
+	return d.data;
 }
 
 unsigned int yocton_prop_enum(struct yocton_prop *p, const char **values)
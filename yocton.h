@@ -33,6 +33,11 @@ extern "C" {
  *
  * Functions for parsing the contents of a Yocton file. The entrypoint
  * for reading is to use @ref yocton_read_with or @ref yocton_read_from.
+ *
+ * Parser instances do not share any state with each other, so separate
+ * parsers can be used concurrently from different threads. Parsing does
+ * not depend on the current locale. A single parser (including all of
+ * its objects and properties) must only be used by one thread at a time.
  */
 
 /**
@@ -157,6 +162,128 @@ int __yocton_prop_have_error(struct yocton_prop *property);
  */
 void yocton_free(struct yocton_object *obj);
 
+/** Type of a resource limit that can be set with @ref yocton_set_limit. */
+enum yocton_limit {
+	/** Maximum length in bytes of a single property name or value. */
+	YOCTON_LIMIT_STRING_LENGTH,
+
+	/**
+	 * Maximum nesting depth of subobjects. The top-level object has
+	 * a depth of zero, so a limit of one allows subobjects but not
+	 * subobjects of subobjects.
+	 */
+	YOCTON_LIMIT_DEPTH,
+
+	/** Maximum number of properties in a single object. */
+	YOCTON_LIMIT_PROPERTIES,
+
+	/** Maximum total number of bytes to read from the input. */
+	YOCTON_LIMIT_INPUT_SIZE,
+
+	/**
+	 * Maximum total number of bytes of memory allocated by the parser
+	 * at any one time. This does not include memory returned to the
+	 * caller, for example by @ref yocton_prop_value_dup or the array
+	 * macros.
+	 */
+	YOCTON_LIMIT_MEMORY,
+};
+
+/**
+ * Set a limit on the resources used when parsing. This is intended for
+ * parsing untrusted input, to put a bound on the amount of memory and
+ * CPU time that can be consumed. If a limit is exceeded, parsing stops
+ * with an error that can be checked using @ref yocton_have_error.
+ *
+ * By default there are no limits. The limits should be set before the
+ * first property is read.
+ *
+ * Example:
+ * ~~~~~~~~~~~~~~~~~~~~~~~
+ *   struct yocton_object *obj = yocton_read_from(fs);
+ *   yocton_set_limit(obj, YOCTON_LIMIT_INPUT_SIZE, 1024 * 1024);
+ *   yocton_set_limit(obj, YOCTON_LIMIT_DEPTH, 16);
+ * ~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * @param obj    Top-level @ref yocton_object.
+ * @param limit  The limit to set.
+ * @param value  New value of the limit, or zero for no limit.
+ */
+void yocton_set_limit(struct yocton_object *obj, enum yocton_limit limit,
+                      size_t value);
+
+/** Flags that can be set with @ref yocton_set_flags. */
+enum yocton_flags {
+	/**
+	 * Check that all strings in the input are valid UTF-8. An invalid
+	 * byte sequence is reported as an error in the same way as other
+	 * syntax errors.
+	 */
+	YOCTON_VALIDATE_UTF8 = 0x01,
+
+	/**
+	 * Calculate a CRC32C checksum of the input as it is read. See
+	 * @ref yocton_checksum and @ref yocton_prop_checksum.
+	 */
+	YOCTON_CHECKSUM = 0x02,
+
+	/**
+	 * Always use the portable C implementations of the parser's inner
+	 * loops. Normally, versions using instruction set extensions such
+	 * as SSE4.2 or AVX2 are chosen at runtime if the CPU supports them.
+	 * This is mainly useful for testing.
+	 */
+	YOCTON_FORCE_SCALAR = 0x04,
+};
+
+/**
+ * Set flags that change the behavior of the parser. The flags should be
+ * set before the first property is read.
+ *
+ * @param obj    Top-level @ref yocton_object.
+ * @param flags  Bitwise-OR of values from @ref yocton_flags, replacing
+ *               any flags that were previously set.
+ */
+void yocton_set_flags(struct yocton_object *obj, unsigned int flags);
+
+/**
+ * Set the size of the buffer that input is read into. Each call to the
+ * read callback passes a buffer of this size; the default is 256 bytes.
+ * A larger buffer means fewer calls to the callback, which can make
+ * reading faster, particularly if the callback has a high per-call cost,
+ * for example if it decompresses the input. The memory used counts
+ * towards @ref YOCTON_LIMIT_MEMORY. If memory cannot be allocated, an
+ * error is stored that can be checked using @ref yocton_have_error.
+ *
+ * @param obj   Top-level @ref yocton_object.
+ * @param size  New size of the buffer in bytes. If this is zero or too
+ *              small to hold input that has been read but not parsed
+ *              yet, the buffer size is not changed.
+ */
+void yocton_set_buffer_size(struct yocton_object *obj, size_t size);
+
+/**
+ * Get the CRC32C checksum of the input that has been read so far. Once
+ * the end of the input has been reached, this is the checksum of the
+ * entire input. The @ref YOCTON_CHECKSUM flag must have been set with
+ * @ref yocton_set_flags before anything was read.
+ *
+ * Example:
+ * ~~~~~~~~~~~~~~~~~~~~~~~
+ *   struct yocton_object *obj = yocton_read_from(fs);
+ *   yocton_set_flags(obj, YOCTON_CHECKSUM);
+ *   ... read all properties ...
+ *   if (!yocton_have_error(obj, NULL, NULL)
+ *    && yocton_checksum(obj) != expected_checksum) {
+ *       ...
+ *   }
+ * ~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * @param obj  Top-level @ref yocton_object.
+ * @return     CRC32C checksum, or zero if checksums are not enabled.
+ */
+uint32_t yocton_checksum(struct yocton_object *obj);
+
 /**
  * Perform an assertion and fail with an error if it isn't true.
  *
@@ -229,6 +356,39 @@ const char *yocton_prop_name(struct yocton_prop *property);
  */
 const char *yocton_prop_value(struct yocton_prop *property);
 
+/**
+ * Read the string value of a @ref yocton_prop incrementally.
+ *
+ * This allows very large values to be processed in pieces without the
+ * whole value being held in memory at once. Each call reads the next part
+ * of the value into the given buffer. Once this function has been used to
+ * read a property's value, @ref yocton_prop_value cannot be used to read
+ * it again.
+ *
+ * It is an error to call this for a property that is not of type
+ * @ref YOCTON_PROP_STRING. Values read this way are not subject to the
+ * @ref YOCTON_LIMIT_STRING_LENGTH limit.
+ *
+ * Example that copies a value to a file:
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *   char buf[4096];
+ *   size_t nbytes;
+ *   while ((nbytes = yocton_prop_value_read(p, buf, sizeof(buf))) > 0) {
+ *       fwrite(buf, 1, nbytes, out);
+ *   }
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * @param property  The property.
+ * @param buf       Buffer to populate with the next part of the value.
+ *                  The data is not NUL-terminated.
+ * @param buf_size  Size of the buffer in bytes.
+ * @return          Number of bytes written into the buffer, or zero once
+ *                  the end of the value has been reached or an error
+ *                  occurs.
+ */
+size_t yocton_prop_value_read(struct yocton_prop *property, void *buf,
+                              size_t buf_size);
+
 /**
  * Get newly-allocated copy of a property value.
  *
@@ -379,6 +539,65 @@ int __yocton_prop_alloc(struct yocton_prop *p, void **ptr, size_t size);
 		} \
 	})
 
+/**
+ * Callback invoked by @ref yocton_prop_raw with input text.
+ *
+ * @param data    Pointer to the input text. This is only valid until the
+ *                callback returns.
+ * @param len     Length of the input text in bytes.
+ * @param handle  Arbitrary pointer, passed through from
+ *                @ref yocton_prop_raw.
+ */
+typedef void (*yocton_raw)(const void *data, size_t len, void *handle);
+
+/**
+ * Pass the input text that makes up the value of a property to a callback,
+ * without decoding it. The callback may be invoked several times, with
+ * consecutive pieces of the text. This is useful for copying parts of the
+ * input to the output unchanged; see @ref yoctonw_copy.
+ *
+ * For a string property, the text is the value as it appears in the
+ * input, including any quotes and escape sequences. It may be followed by
+ * whitespace and comments. For a subobject, the text is everything after
+ * the opening '{', up to and including the closing '}'. The input is still
+ * checked for errors as it is read, but the value of a string property or
+ * the properties of a subobject cannot be read after this is called.
+ *
+ * @param property  The property.
+ * @param callback  Callback to invoke with the input text.
+ * @param handle    Arbitrary pointer passed through to the callback.
+ */
+void yocton_prop_raw(struct yocton_prop *property, yocton_raw callback,
+                     void *handle);
+
+/* Helper function for yoctonw_copy: nesting depth of a property. */
+size_t __yocton_prop_depth(struct yocton_prop *property);
+
+/* Helper function for yoctonw_copy: whether the text passed to the
+ * yocton_prop_raw() callback ends in a comment. */
+int __yocton_prop_ends_in_comment(struct yocton_prop *property);
+
+/**
+ * Get the CRC32C checksum of the input that makes up a top-level property.
+ *
+ * The checksum covers the input from the end of the previous top-level
+ * property (so including any comments and whitespace before the property)
+ * up to the end of this property. The checksums of consecutive properties
+ * therefore cover the entire input, apart from anything that follows the
+ * last property. The @ref YOCTON_CHECKSUM flag must have been set with
+ * @ref yocton_set_flags.
+ *
+ * This should be called after the property has been read. Any part of
+ * the property that has not been read yet is skipped over; the value of a
+ * string property remains available from @ref yocton_prop_value, but the
+ * properties of a subobject cannot be read after this is called.
+ *
+ * @param property  The property. It is an error if this is not a property
+ *                  of the top-level object.
+ * @return          CRC32C checksum, or zero if checksums are not enabled.
+ */
+uint32_t yocton_prop_checksum(struct yocton_prop *property);
+
 /**
  * Get the inner object associated with a @ref yocton_prop of type
  * @ref YOCTON_PROP_OBJECT. It is an error to call this for a property that
@@ -584,6 +803,34 @@ unsigned long long yocton_prop_uint(struct yocton_prop *property, size_t n);
 		} \
 	})
 
+/**
+ * Decode the property value as base64-encoded binary data.
+ *
+ * The value is decoded as it is read from the input, so the encoded form
+ * of the value is never held in memory. Both padded and unpadded values
+ * are accepted, but the value must not contain any whitespace. Since the
+ * value is read using @ref yocton_prop_value_read, the value cannot be
+ * read again once it has been decoded, and decoding it a second time is
+ * an error.
+ *
+ * Example:
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *   // Example of data being parsed:
+ *   //   data: "aGVsbG8gd29ybGQ="
+ *   size_t data_len;
+ *   uint8_t *data = yocton_prop_base64(p, &data_len);
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * @param property  The property.
+ * @param len       Pointer to a variable to receive the length of the
+ *                  decoded data in bytes.
+ * @return          Newly-allocated buffer containing the decoded data,
+ *                  which must be freed by the caller, or NULL if the value
+ *                  is not valid base64 or a memory allocation failure
+ *                  occurred. The data is not NUL-terminated.
+ */
+void *yocton_prop_base64(struct yocton_prop *property, size_t *len);
+
 /**
  * Parse the property value as an enumeration.
  *
@@ -0,0 +1,261 @@
+//
+// Copyright (c) 2022, Simon Howard
+//
+// Permission to use, copy, modify, and/or distribute this software
+// for any purpose with or without fee is hereby granted, provided
+// that the above copyright notice and this permission notice appear
+// in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+// WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+// AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+#include "yocton_batch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "yocton.h"
+
+#define ERROR_ALLOC "memory allocation failure"
+#define ERROR_OPEN  "failed to open file"
+#define ERROR_DIR   "failed to read directory"
+
+#define MAX_THREADS 256
+
+struct batch {
+	const char **filenames;
+	size_t num_filenames;
+	yocton_batch_parse parse_callback;
+	yocton_batch_error error_callback;
+	void *callback_handle;
+	// Index of next file to read, and number of failed files. Both are
+	// protected by lock.
+	pthread_mutex_t lock;
+	size_t next_file;
+	size_t num_failed;
+};
+
+// Default parse callback that just reads through everything.
+static void read_all(const char *filename, struct yocton_object *obj,
+                     void *handle)
+{
+	struct yocton_prop *p;
+
+	while ((p = yocton_next_prop(obj)) != NULL) {
+		if (yocton_prop_type(p) == YOCTON_PROP_OBJECT) {
+			read_all(filename, yocton_prop_inner(p), handle);
+		}
+	}
+}
+
+static void batch_error(struct batch *b, const char *filename, int lineno,
+                        const char *error_msg)
+{
+	if (b->error_callback != NULL) {
+		b->error_callback(filename, lineno, error_msg,
+		                  b->callback_handle);
+	}
+}
+
+// Read a single file; returns zero if there was an error.
+static int read_file(struct batch *b, const char *filename)
+{
+	struct yocton_object *obj;
+	FILE *fstream;
+	const char *error_msg;
+	int lineno, success = 1;
+
+	fstream = fopen(filename, "r");
+	if (fstream == NULL) {
+		batch_error(b, filename, 0, ERROR_OPEN);
+		return 0;
+	}
+	obj = yocton_read_from(fstream);
+	if (obj == NULL) {
+		batch_error(b, filename, 0, ERROR_ALLOC);
+		fclose(fstream);
+		return 0;
+	}
+	b->parse_callback(filename, obj, b->callback_handle);
+	if (yocton_have_error(obj, &lineno, &error_msg)) {
+		batch_error(b, filename, lineno, error_msg);
+		success = 0;
+	}
+	yocton_free(obj);
+	fclose(fstream);
+
+	return success;
+}
+
+static void *worker_thread(void *arg)
+{
+	struct batch *b = (struct batch *) arg;
+	size_t idx;
+
+	for (;;) {
+		pthread_mutex_lock(&b->lock);
+		idx = b->next_file;
+		if (idx < b->num_filenames) {
+			++b->next_file;
+		}
+		pthread_mutex_unlock(&b->lock);
+		if (idx >= b->num_filenames) {
+			break;
+		}
+		if (!read_file(b, b->filenames[idx])) {
+			pthread_mutex_lock(&b->lock);
+			++b->num_failed;
+			pthread_mutex_unlock(&b->lock);
+		}
+	}
+
+	return NULL;
+}
+
+static unsigned int default_num_threads(void)
+{
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return ncpus < 1 ? 1 : (unsigned int) ncpus;
+}
+
+size_t yocton_read_files(const char **filenames, size_t num_filenames,
+                         unsigned int num_threads,
+                         yocton_batch_parse parse_callback,
+                         yocton_batch_error error_callback, void *handle)
+{
+	pthread_t threads[MAX_THREADS];
+	struct batch b;
+	unsigned int i, started;
+
+	b.filenames = filenames;
+	b.num_filenames = num_filenames;
+	b.parse_callback = parse_callback != NULL ? parse_callback : read_all;
+	b.error_callback = error_callback;
+	b.callback_handle = handle;
+	b.next_file = 0;
+	b.num_failed = 0;
+	pthread_mutex_init(&b.lock, NULL);
+
+	if (num_threads == 0) {
+		num_threads = default_num_threads();
+	}
+	if (num_threads > MAX_THREADS) {
+		num_threads = MAX_THREADS;
+	}
+	if (num_threads > num_filenames) {
+		num_threads = (unsigned int) num_filenames;
+	}
+
+	// The calling thread acts as one of the workers, so we start one
+	// fewer thread than requested. If a thread cannot be started, the
+	// remaining workers just pick up more of the files.
+	for (started = 0; started + 1 < num_threads; ++started) {
+		if (pthread_create(&threads[started], NULL,
+		                   worker_thread, &b) != 0) {
+			break;
+		}
+	}
+	worker_thread(&b);
+	for (i = 0; i < started; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+
+	pthread_mutex_destroy(&b.lock);
+	return b.num_failed;
+}
+
+static int has_yocton_suffix(const char *filename)
+{
+	static const char suffix[] = ".yocton";
+	size_t len = strlen(filename);
+
+	return len > sizeof(suffix) - 1
+	    && !strcmp(filename + len - sizeof(suffix) + 1, suffix);
+}
+
+static void free_filenames(char **filenames, size_t num_filenames)
+{
+	size_t i;
+
+	for (i = 0; i < num_filenames; ++i) {
+		free(filenames[i]);
+	}
+	free(filenames);
+}
+
+size_t yocton_read_dir(const char *dirname, unsigned int num_threads,
+                       yocton_batch_parse parse_callback,
+                       yocton_batch_error error_callback, void *handle)
+{
+	char **filenames = NULL, **new_filenames;
+	size_t num_filenames = 0, filenames_size = 0, result;
+	struct dirent *entry;
+	struct stat st;
+	DIR *dir;
+	char *path;
+
+	dir = opendir(dirname);
+	if (dir == NULL) {
+		if (error_callback != NULL) {
+			error_callback(dirname, 0, ERROR_DIR, handle);
+		}
+		return 1;
+	}
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (!has_yocton_suffix(entry->d_name)) {
+			continue;
+		}
+		if (num_filenames >= filenames_size) {
+			filenames_size = filenames_size == 0 ?
+			    64 : filenames_size * 2;
+			new_filenames = (char **) realloc(
+			    filenames, filenames_size * sizeof(char *));
+			if (new_filenames == NULL) {
+				goto fail;
+			}
+			filenames = new_filenames;
+		}
+		path = (char *) malloc(strlen(dirname)
+		                       + strlen(entry->d_name) + 2);
+		if (path == NULL) {
+			goto fail;
+		}
+		sprintf(path, "%s/%s", dirname, entry->d_name);
+		// Skip directories and anything else that is not a file,
+		// even if its name ends in .yocton.
+		if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+			free(path);
+			continue;
+		}
+		filenames[num_filenames] = path;
+		++num_filenames;
+	}
+	closedir(dir);
+
+	result = yocton_read_files((const char **) filenames, num_filenames,
+	                           num_threads, parse_callback,
+	                           error_callback, handle);
+	free_filenames(filenames, num_filenames);
+	return result;
+
+fail:
+	closedir(dir);
+	free_filenames(filenames, num_filenames);
+	if (error_callback != NULL) {
+		error_callback(dirname, 0, ERROR_ALLOC, handle);
+	}
+	return 1;
+}
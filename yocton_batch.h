@@ -0,0 +1,138 @@
+//
+// Copyright (c) 2022, Simon Howard
+//
+// Permission to use, copy, modify, and/or distribute this software
+// for any purpose with or without fee is hereby granted, provided
+// that the above copyright notice and this permission notice appear
+// in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+// WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+// AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+#ifndef YOCTON_BATCH_H
+#define YOCTON_BATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+
+#include "yocton.h"
+
+/**
+ * @file yocton_batch.h
+ *
+ * Functions for parsing many Yocton files in parallel. Each file is read
+ * by its own parser on one of a pool of worker threads. The entrypoint is
+ * to use @ref yocton_read_files or @ref yocton_read_dir.
+ */
+
+/**
+ * Callback invoked to read the contents of a file.
+ *
+ * The callback is invoked from a worker thread, and may be invoked for
+ * several files at once; any state shared through the handle must be
+ * protected by the caller. There is no need to check for parse errors
+ * inside the callback; these are reported through the error callback
+ * once the callback returns.
+ *
+ * @param filename  Path of the file being read.
+ * @param obj       Top-level @ref yocton_object for the file. This is
+ *                  freed once the callback returns.
+ * @param handle    Arbitrary pointer, passed through from
+ *                  @ref yocton_read_files.
+ */
+typedef void (*yocton_batch_parse)(const char *filename,
+                                   struct yocton_object *obj, void *handle);
+
+/**
+ * Callback invoked when a file could not be read. Like the parse
+ * callback, this is invoked from a worker thread.
+ *
+ * @param filename   Path of the file that could not be read.
+ * @param lineno     Line number on which the error occurred, or zero if
+ *                   the file could not be opened at all.
+ * @param error_msg  Message describing the error.
+ * @param handle     Arbitrary pointer, passed through from
+ *                   @ref yocton_read_files.
+ */
+typedef void (*yocton_batch_error)(const char *filename, int lineno,
+                                   const char *error_msg, void *handle);
+
+/**
+ * Parse a list of files in parallel.
+ *
+ * Example that reads a list of config fragments:
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *   static void parse_fragment(const char *filename,
+ *                              struct yocton_object *obj, void *handle) {
+ *       struct yocton_prop *p;
+ *       while ((p = yocton_next_prop(obj)) != NULL) {
+ *           ...
+ *       }
+ *   }
+ *
+ *   static void fragment_error(const char *filename, int lineno,
+ *                              const char *error_msg, void *handle) {
+ *       fprintf(stderr, "%s:%d: %s\n", filename, lineno, error_msg);
+ *   }
+ *
+ *   yocton_read_files(filenames, num_filenames, 0,
+ *                     parse_fragment, fragment_error, NULL);
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * @param filenames       Array of paths of files to read.
+ * @param num_filenames   Number of paths in the filenames array.
+ * @param num_threads     Number of worker threads to use, or zero to use
+ *                        one thread per online CPU.
+ * @param parse_callback  Callback to invoke to read each file. If this is
+ *                        NULL, every file is read through to the end and
+ *                        only checked for errors.
+ * @param error_callback  Callback to invoke if a file cannot be read. May
+ *                        be NULL.
+ * @param handle          Arbitrary pointer passed through when the
+ *                        callbacks are invoked.
+ * @return                Number of files that could not be read
+ *                        successfully; zero means that every file was
+ *                        read without error.
+ */
+size_t yocton_read_files(const char **filenames, size_t num_filenames,
+                         unsigned int num_threads,
+                         yocton_batch_parse parse_callback,
+                         yocton_batch_error error_callback, void *handle);
+
+/**
+ * Parse all files in a directory in parallel.
+ *
+ * Every file in the directory with a name ending in `.yocton` is read, in
+ * the same way as @ref yocton_read_files. Subdirectories are not searched.
+ *
+ * @param dirname         Path of the directory to read.
+ * @param num_threads     Number of worker threads to use, or zero to use
+ *                        one thread per online CPU.
+ * @param parse_callback  Callback to invoke to read each file, or NULL.
+ * @param error_callback  Callback to invoke if a file cannot be read. May
+ *                        be NULL. If the directory itself cannot be read,
+ *                        this is invoked with the directory path.
+ * @param handle          Arbitrary pointer passed through when the
+ *                        callbacks are invoked.
+ * @return                Number of files that could not be read
+ *                        successfully.
+ */
+size_t yocton_read_dir(const char *dirname, unsigned int num_threads,
+                       yocton_batch_parse parse_callback,
+                       yocton_batch_error error_callback, void *handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef YOCTON_BATCH_H */
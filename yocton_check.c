@@ -0,0 +1,111 @@
+//
+// Copyright (c) 2022, Simon Howard
+//
+// Permission to use, copy, modify, and/or distribute this software
+// for any purpose with or without fee is hereby granted, provided
+// that the above copyright notice and this permission notice appear
+// in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+// WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+// AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+// Program that checks a set of .yocton files (or directories containing
+// them) for syntax errors, reading the files in parallel.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "yocton_batch.h"
+
+static void print_error(const char *filename, int lineno,
+                        const char *error_msg, void *handle)
+{
+	if (lineno > 0) {
+		fprintf(stderr, "%s:%d: %s\n", filename, lineno, error_msg);
+	} else {
+		fprintf(stderr, "%s: %s\n", filename, error_msg);
+	}
+}
+
+static int is_directory(const char *path)
+{
+	struct stat st;
+	return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// Parse the argument to -j, which must be a number of threads, or zero to
+// use one thread per CPU.
+static int parse_num_threads(const char *arg, unsigned int *num_threads)
+{
+	char *end;
+	long value;
+
+	errno = 0;
+	value = strtol(arg, &end, 10);
+	if (end == arg || *end != '\0' || errno != 0
+	 || value < 0 || (unsigned long) value > UINT_MAX) {
+		return 0;
+	}
+	*num_threads = (unsigned int) value;
+	return 1;
+}
+
+static void usage(const char *progname)
+{
+	printf("Usage: %s [-j threads] <file or directory>...\n", progname);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	const char **filenames;
+	size_t num_filenames = 0, failed = 0;
+	unsigned int num_threads = 0;
+	int i;
+
+	filenames = (const char **) calloc(argc, sizeof(char *));
+	if (filenames == NULL) {
+		fprintf(stderr, "Memory allocation failure\n");
+		exit(1);
+	}
+
+	// Options come before any files or directories.
+	for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+		if (!strcmp(argv[i], "-j") && i + 1 < argc
+		 && parse_num_threads(argv[i + 1], &num_threads)) {
+			++i;
+		} else {
+			usage(argv[0]);
+		}
+	}
+	if (i >= argc) {
+		usage(argv[0]);
+	}
+
+	for (; i < argc; ++i) {
+		if (is_directory(argv[i])) {
+			failed += yocton_read_dir(argv[i], num_threads, NULL,
+			                          print_error, NULL);
+		} else {
+			filenames[num_filenames] = argv[i];
+			++num_filenames;
+		}
+	}
+
+	failed += yocton_read_files(filenames, num_filenames, num_threads,
+	                            NULL, print_error, NULL);
+	free(filenames);
+
+	exit(failed != 0);
+}
@@ -0,0 +1,44 @@
+#!/bin/sh
+#
+# Checks that yocton_check reports the same errors when reading the test
+# files with several threads as it does with a single thread. The order
+# that errors are reported in depends on timing, so is not compared.
+
+single=$(./yocton_check -j 1 tests 2>&1)
+single_status=$?
+multi=$(./yocton_check -j 4 tests 2>&1)
+multi_status=$?
+
+if [ "$single_status" != "$multi_status" ]; then
+	echo "yocton_check: exit status $multi_status with -j 4," \
+	     "$single_status with -j 1" >&2
+	exit 1
+fi
+if [ "$(echo "$single" | sort)" != "$(echo "$multi" | sort)" ]; then
+	echo "yocton_check: different errors reported with -j 4:" >&2
+	echo "$multi" >&2
+	exit 1
+fi
+if [ -z "$single" ]; then
+	echo "yocton_check: no errors reported for error test files" >&2
+	exit 1
+fi
+
+# Directories are skipped even if their names end in .yocton.
+tmpdir=$(mktemp -d)
+trap 'rm -rf "$tmpdir"' EXIT
+mkdir "$tmpdir/subdir.yocton"
+echo "foo: bar" > "$tmpdir/file.yocton"
+if ! output=$(./yocton_check "$tmpdir" 2>&1) || [ -n "$output" ]; then
+	echo "yocton_check: failed on directory named *.yocton:" >&2
+	echo "$output" >&2
+	exit 1
+fi
+
+# Invalid thread counts are rejected.
+for arg in abc -3 ""; do
+	if ./yocton_check -j "$arg" "$tmpdir" >/dev/null 2>&1; then
+		echo "yocton_check: accepted -j '$arg'" >&2
+		exit 1
+	fi
+done
@@ -0,0 +1,117 @@
+//
+// Copyright (c) 2022, Simon Howard
+//
+// Permission to use, copy, modify, and/or distribute this software
+// for any purpose with or without fee is hereby granted, provided
+// that the above copyright notice and this permission notice appear
+// in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+// WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+// AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+// Program that reads a .yocton file and writes it back out in a standard
+// format, or with -c, in compact (minified) form.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "yocton.h"
+#include "yoctonw.h"
+
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+
+static void copy_object(struct yocton_object *obj, struct yoctonw_writer *w)
+{
+	struct yocton_prop *p;
+
+	while ((p = yocton_next_prop(obj)) != NULL) {
+		if (yocton_prop_type(p) == YOCTON_PROP_OBJECT) {
+			yoctonw_subobject(w, yocton_prop_name(p));
+			copy_object(yocton_prop_inner(p), w);
+			yoctonw_end(w);
+		} else {
+			yoctonw_prop(w, yocton_prop_name(p),
+			             yocton_prop_value(p));
+		}
+	}
+}
+
+static void usage(const char *progname)
+{
+	printf("Usage: %s [-c] [filename]\n", progname);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	FILE *fstream = stdin;
+	struct yocton_object *obj;
+	struct yoctonw_writer *w;
+	const char *filename = NULL, *error;
+	int i, compact = 0, error_lineno, success = 1;
+
+	for (i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-c")) {
+			compact = 1;
+		} else if (filename == NULL) {
+			filename = argv[i];
+		} else {
+			usage(argv[0]);
+		}
+	}
+	if (filename != NULL && strcmp(filename, "-") != 0) {
+		fstream = fopen(filename, "r");
+		if (fstream == NULL) {
+			fprintf(stderr, "Error opening %s: %s\n",
+			        filename, strerror(errno));
+			exit(1);
+		}
+	}
+
+	obj = yocton_read_from(fstream);
+	w = yoctonw_write_to(stdout);
+	if (obj == NULL || w == NULL) {
+		fprintf(stderr, "Memory allocation failure\n");
+		exit(1);
+	}
+	yoctonw_set_flush_policy(w, YOCTONW_FLUSH_FULL, 0);
+	yoctonw_set_buffer_size(w, OUTPUT_BUFFER_SIZE);
+	if (compact) {
+		yoctonw_set_flags(w, YOCTONW_COMPACT);
+	}
+
+	copy_object(obj, w);
+	if (compact) {
+		yoctonw_flush(w);
+		putchar('\n');
+	}
+	if (yocton_have_error(obj, &error_lineno, &error)) {
+		fprintf(stderr, "%d: %s\n", error_lineno, error);
+		success = 0;
+	}
+	yoctonw_flush(w);
+	if (yoctonw_have_error(w)) {
+		fprintf(stderr, "Error writing output\n");
+		success = 0;
+	}
+	yoctonw_free(w);
+	if (fflush(stdout) != 0) {
+		fprintf(stderr, "Error writing output: %s\n", strerror(errno));
+		success = 0;
+	}
+	yocton_free(obj);
+	if (fstream != stdin) {
+		fclose(fstream);
+	}
+
+	exit(!success);
+}
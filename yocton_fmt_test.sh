@@ -0,0 +1,31 @@
+#!/bin/sh
+#
+# Checks that the output of yocton_fmt, in both normal and compact mode,
+# reads back as the same properties as the input. Test files that
+# yocton_fmt reports an error for are skipped.
+
+tmp=$(mktemp)
+trap 'rm -f "$tmp"' EXIT
+status=0
+checked=0
+
+for f in tests/*.yocton; do
+	expected=$(./yocton_print "$f" 2>&1)
+	for flags in "" "-c"; do
+		if ! ./yocton_fmt $flags "$f" >"$tmp" 2>/dev/null; then
+			continue
+		fi
+		got=$(./yocton_print "$tmp" 2>&1)
+		if [ "$got" != "$expected" ]; then
+			echo "yocton_fmt $flags $f: output does not round-trip" >&2
+			status=1
+		fi
+		checked=$((checked + 1))
+	done
+done
+
+if [ "$checked" = 0 ]; then
+	echo "yocton_fmt: no test files could be formatted" >&2
+	exit 1
+fi
+exit $status
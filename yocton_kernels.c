@@ -0,0 +1,287 @@
+//
+// Copyright (c) 2022, Simon Howard
+//
+// Permission to use, copy, modify, and/or distribute this software
+// for any purpose with or without fee is hereby granted, provided
+// that the above copyright notice and this permission notice appear
+// in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+// WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+// AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+#include "yocton_kernels.h"
+
+// Runtime dispatch is only implemented for x86 with GCC-compatible
+// compilers, which let us compile individual functions for instruction
+// set extensions that the rest of the program does not assume.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define X86_DISPATCH
+#include <string.h>
+#include <immintrin.h>
+#define TARGET(x) __attribute__((target(x)))
+#endif
+
+static const uint32_t crc32c_table[256] = {
+	0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4,
+	0xc79a971f, 0x35f1141c, 0x26a1e7e8, 0xd4ca64eb,
+	0x8ad958cf, 0x78b2dbcc, 0x6be22838, 0x9989ab3b,
+	0x4d43cfd0, 0xbf284cd3, 0xac78bf27, 0x5e133c24,
+	0x105ec76f, 0xe235446c, 0xf165b798, 0x030e349b,
+	0xd7c45070, 0x25afd373, 0x36ff2087, 0xc494a384,
+	0x9a879fa0, 0x68ec1ca3, 0x7bbcef57, 0x89d76c54,
+	0x5d1d08bf, 0xaf768bbc, 0xbc267848, 0x4e4dfb4b,
+	0x20bd8ede, 0xd2d60ddd, 0xc186fe29, 0x33ed7d2a,
+	0xe72719c1, 0x154c9ac2, 0x061c6936, 0xf477ea35,
+	0xaa64d611, 0x580f5512, 0x4b5fa6e6, 0xb93425e5,
+	0x6dfe410e, 0x9f95c20d, 0x8cc531f9, 0x7eaeb2fa,
+	0x30e349b1, 0xc288cab2, 0xd1d83946, 0x23b3ba45,
+	0xf779deae, 0x05125dad, 0x1642ae59, 0xe4292d5a,
+	0xba3a117e, 0x4851927d, 0x5b016189, 0xa96ae28a,
+	0x7da08661, 0x8fcb0562, 0x9c9bf696, 0x6ef07595,
+	0x417b1dbc, 0xb3109ebf, 0xa0406d4b, 0x522bee48,
+	0x86e18aa3, 0x748a09a0, 0x67dafa54, 0x95b17957,
+	0xcba24573, 0x39c9c670, 0x2a993584, 0xd8f2b687,
+	0x0c38d26c, 0xfe53516f, 0xed03a29b, 0x1f682198,
+	0x5125dad3, 0xa34e59d0, 0xb01eaa24, 0x42752927,
+	0x96bf4dcc, 0x64d4cecf, 0x77843d3b, 0x85efbe38,
+	0xdbfc821c, 0x2997011f, 0x3ac7f2eb, 0xc8ac71e8,
+	0x1c661503, 0xee0d9600, 0xfd5d65f4, 0x0f36e6f7,
+	0x61c69362, 0x93ad1061, 0x80fde395, 0x72966096,
+	0xa65c047d, 0x5437877e, 0x4767748a, 0xb50cf789,
+	0xeb1fcbad, 0x197448ae, 0x0a24bb5a, 0xf84f3859,
+	0x2c855cb2, 0xdeeedfb1, 0xcdbe2c45, 0x3fd5af46,
+	0x7198540d, 0x83f3d70e, 0x90a324fa, 0x62c8a7f9,
+	0xb602c312, 0x44694011, 0x5739b3e5, 0xa55230e6,
+	0xfb410cc2, 0x092a8fc1, 0x1a7a7c35, 0xe811ff36,
+	0x3cdb9bdd, 0xceb018de, 0xdde0eb2a, 0x2f8b6829,
+	0x82f63b78, 0x709db87b, 0x63cd4b8f, 0x91a6c88c,
+	0x456cac67, 0xb7072f64, 0xa457dc90, 0x563c5f93,
+	0x082f63b7, 0xfa44e0b4, 0xe9141340, 0x1b7f9043,
+	0xcfb5f4a8, 0x3dde77ab, 0x2e8e845f, 0xdce5075c,
+	0x92a8fc17, 0x60c37f14, 0x73938ce0, 0x81f80fe3,
+	0x55326b08, 0xa759e80b, 0xb4091bff, 0x466298fc,
+	0x1871a4d8, 0xea1a27db, 0xf94ad42f, 0x0b21572c,
+	0xdfeb33c7, 0x2d80b0c4, 0x3ed04330, 0xccbbc033,
+	0xa24bb5a6, 0x502036a5, 0x4370c551, 0xb11b4652,
+	0x65d122b9, 0x97baa1ba, 0x84ea524e, 0x7681d14d,
+	0x2892ed69, 0xdaf96e6a, 0xc9a99d9e, 0x3bc21e9d,
+	0xef087a76, 0x1d63f975, 0x0e330a81, 0xfc588982,
+	0xb21572c9, 0x407ef1ca, 0x532e023e, 0xa145813d,
+	0x758fe5d6, 0x87e466d5, 0x94b49521, 0x66df1622,
+	0x38cc2a06, 0xcaa7a905, 0xd9f75af1, 0x2b9cd9f2,
+	0xff56bd19, 0x0d3d3e1a, 0x1e6dcdee, 0xec064eed,
+	0xc38d26c4, 0x31e6a5c7, 0x22b65633, 0xd0ddd530,
+	0x0417b1db, 0xf67c32d8, 0xe52cc12c, 0x1747422f,
+	0x49547e0b, 0xbb3ffd08, 0xa86f0efc, 0x5a048dff,
+	0x8ecee914, 0x7ca56a17, 0x6ff599e3, 0x9d9e1ae0,
+	0xd3d3e1ab, 0x21b862a8, 0x32e8915c, 0xc083125f,
+	0x144976b4, 0xe622f5b7, 0xf5720643, 0x07198540,
+	0x590ab964, 0xab613a67, 0xb831c993, 0x4a5a4a90,
+	0x9e902e7b, 0x6cfbad78, 0x7fab5e8c, 0x8dc0dd8f,
+	0xe330a81a, 0x115b2b19, 0x020bd8ed, 0xf0605bee,
+	0x24aa3f05, 0xd6c1bc06, 0xc5914ff2, 0x37faccf1,
+	0x69e9f0d5, 0x9b8273d6, 0x88d28022, 0x7ab90321,
+	0xae7367ca, 0x5c18e4c9, 0x4f48173d, 0xbd23943e,
+	0xf36e6f75, 0x0105ec76, 0x12551f82, 0xe03e9c81,
+	0x34f4f86a, 0xc69f7b69, 0xd5cf889d, 0x27a40b9e,
+	0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e,
+	0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351,
+};
+
+static uint32_t crc32c_scalar(uint32_t crc, const uint8_t *data, size_t len)
+{
+	size_t i;
+
+	crc = ~crc;
+	for (i = 0; i < len; ++i) {
+		crc = crc32c_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+static size_t string_span_scalar(const uint8_t *data, size_t len,
+                                 int ascii_only)
+{
+	size_t i;
+	uint8_t c;
+
+	for (i = 0; i < len; ++i) {
+		c = data[i];
+		if (c < 0x20 || c == '"' || c == '\\'
+		 || (ascii_only && c >= 0x80)) {
+			break;
+		}
+	}
+	return i;
+}
+
+static const struct yocton_kernels scalar_kernels = {
+	"scalar", crc32c_scalar, string_span_scalar,
+};
+
+#ifdef X86_DISPATCH
+
+TARGET("sse4.2")
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *data, size_t len)
+{
+	size_t i = 0;
+
+	crc = ~crc;
+#ifdef __x86_64__
+	for (; i + 8 <= len; i += 8) {
+		uint64_t v;
+		memcpy(&v, data + i, sizeof(v));
+		crc = (uint32_t) _mm_crc32_u64(crc, v);
+	}
+#else
+	for (; i + 4 <= len; i += 4) {
+		uint32_t v;
+		memcpy(&v, data + i, sizeof(v));
+		crc = _mm_crc32_u32(crc, v);
+	}
+#endif
+	for (; i < len; ++i) {
+		crc = _mm_crc32_u8(crc, data[i]);
+	}
+	return ~crc;
+}
+
+// The vector versions of string_span compare a block of bytes at a time
+// and stop at the first block containing a byte that ends the run. For
+// ascii_only, a signed comparison against 0x20 catches both control
+// characters and bytes >= 0x80 (which are negative).
+
+TARGET("sse2")
+static size_t string_span_sse2(const uint8_t *data, size_t len,
+                               int ascii_only)
+{
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i space = _mm_set1_epi8(0x20);
+	const __m128i max_control = _mm_set1_epi8(0x1f);
+	__m128i v, stop;
+	unsigned int mask;
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		v = _mm_loadu_si128((const __m128i *) (data + i));
+		stop = _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+		                    _mm_cmpeq_epi8(v, backslash));
+		if (ascii_only) {
+			stop = _mm_or_si128(stop, _mm_cmplt_epi8(v, space));
+		} else {
+			stop = _mm_or_si128(stop, _mm_cmpeq_epi8(
+			    _mm_min_epu8(v, max_control), v));
+		}
+		mask = (unsigned int) _mm_movemask_epi8(stop);
+		if (mask != 0) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+	return i + string_span_scalar(data + i, len - i, ascii_only);
+}
+
+TARGET("avx2")
+static size_t string_span_avx2(const uint8_t *data, size_t len,
+                               int ascii_only)
+{
+	const __m256i quote = _mm256_set1_epi8('"');
+	const __m256i backslash = _mm256_set1_epi8('\\');
+	const __m256i space = _mm256_set1_epi8(0x20);
+	const __m256i max_control = _mm256_set1_epi8(0x1f);
+	__m256i v, stop;
+	unsigned int mask;
+	size_t i;
+
+	for (i = 0; i + 32 <= len; i += 32) {
+		v = _mm256_loadu_si256((const __m256i *) (data + i));
+		stop = _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+		                       _mm256_cmpeq_epi8(v, backslash));
+		if (ascii_only) {
+			stop = _mm256_or_si256(
+			    stop, _mm256_cmpgt_epi8(space, v));
+		} else {
+			stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(
+			    _mm256_min_epu8(v, max_control), v));
+		}
+		mask = (unsigned int) _mm256_movemask_epi8(stop);
+		if (mask != 0) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+	return i + string_span_sse2(data + i, len - i, ascii_only);
+}
+
+TARGET("avx512bw")
+static size_t string_span_avx512(const uint8_t *data, size_t len,
+                                 int ascii_only)
+{
+	const __m512i quote = _mm512_set1_epi8('"');
+	const __m512i backslash = _mm512_set1_epi8('\\');
+	const __m512i space = _mm512_set1_epi8(0x20);
+	__m512i v;
+	__mmask64 stop;
+	size_t i;
+
+	for (i = 0; i + 64 <= len; i += 64) {
+		v = _mm512_loadu_si512((const void *) (data + i));
+		stop = _mm512_cmpeq_epi8_mask(v, quote)
+		     | _mm512_cmpeq_epi8_mask(v, backslash);
+		if (ascii_only) {
+			stop |= _mm512_cmplt_epi8_mask(v, space);
+		} else {
+			stop |= _mm512_cmplt_epu8_mask(v, space);
+		}
+		if (stop != 0) {
+			return i + __builtin_ctzll(stop);
+		}
+	}
+	return i + string_span_sse2(data + i, len - i, ascii_only);
+}
+
+static const struct yocton_kernels sse2_kernels = {
+	"sse2", crc32c_scalar, string_span_sse2,
+};
+
+static const struct yocton_kernels sse42_kernels = {
+	"sse4.2", crc32c_sse42, string_span_sse2,
+};
+
+static const struct yocton_kernels avx2_kernels = {
+	"avx2", crc32c_sse42, string_span_avx2,
+};
+
+static const struct yocton_kernels avx512_kernels = {
+	"avx512bw", crc32c_sse42, string_span_avx512,
+};
+
+#endif /* #ifdef X86_DISPATCH */
+
+const struct yocton_kernels *__yocton_kernels(int force_scalar)
+{
+	if (force_scalar) {
+		return &scalar_kernels;
+	}
+#ifdef X86_DISPATCH
+	// The AVX2 and AVX-512 kernel sets also use the SSE4.2 CRC32C
+	// instruction; every CPU with AVX2 has SSE4.2 anyway.
+	if (__builtin_cpu_supports("sse4.2")) {
+		if (__builtin_cpu_supports("avx512bw")) {
+			return &avx512_kernels;
+		} else if (__builtin_cpu_supports("avx2")) {
+			return &avx2_kernels;
+		}
+		return &sse42_kernels;
+	} else if (__builtin_cpu_supports("sse2")) {
+		return &sse2_kernels;
+	}
+#endif
+	return &scalar_kernels;
+}
@@ -0,0 +1,49 @@
+//
+// Copyright (c) 2022, Simon Howard
+//
+// Permission to use, copy, modify, and/or distribute this software
+// for any purpose with or without fee is hereby granted, provided
+// that the above copyright notice and this permission notice appear
+// in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+// WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+// AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+// Internal interface to the low-level kernels used by the parser and
+// writer. Several implementations of each kernel exist, using different
+// instruction set extensions; the best one for the CPU we are running on
+// is chosen at runtime, so that a single binary can be shipped to
+// machines with different capabilities. Not part of the public API.
+
+#ifndef YOCTON_KERNELS_H
+#define YOCTON_KERNELS_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+struct yocton_kernels {
+	// Name of the implementation, for debugging.
+	const char *name;
+	// Calculate CRC32C (Castagnoli) checksum; the crc argument is the
+	// result from a previous call, or zero to start a new checksum.
+	uint32_t (*crc32c)(uint32_t crc, const uint8_t *data, size_t len);
+	// Returns the length of the run of bytes at the start of data that
+	// can appear in a quoted string as-is: that is, stopping at the
+	// first '"', '\\' or control character. If ascii_only is nonzero,
+	// the run also stops at the first byte >= 0x80.
+	size_t (*string_span)(const uint8_t *data, size_t len,
+	                      int ascii_only);
+};
+
+// Returns the best kernels for the current CPU, or the portable C
+// versions if force_scalar is nonzero.
+const struct yocton_kernels *__yocton_kernels(int force_scalar);
+
+#endif /* #ifndef YOCTON_KERNELS_H */
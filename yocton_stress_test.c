@@ -0,0 +1,175 @@
+//
+// Copyright (c) 2022, Simon Howard
+//
+// Permission to use, copy, modify, and/or distribute this software
+// for any purpose with or without fee is hereby granted, provided
+// that the above copyright notice and this permission notice appear
+// in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+// WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+// AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+// Stress test that parses the test files from many threads at once and
+// checks that every thread gets exactly the same result as parsing the
+// file from a single thread.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <locale.h>
+#include <pthread.h>
+
+#include "yocton.h"
+
+#define NUM_THREADS 16
+#define NUM_ITERATIONS 20
+
+struct digest {
+	char *data;
+	size_t len, size;
+};
+
+struct test_state {
+	char **filenames;
+	char **expected;
+	int num_files;
+};
+
+struct thread_data {
+	struct test_state *state;
+	// Only written by the thread itself, and read once it has finished.
+	int failed;
+};
+
+static void digest_append(struct digest *d, const char *s)
+{
+	size_t len = strlen(s);
+
+	if (d->len + len + 1 > d->size) {
+		while (d->len + len + 1 > d->size) {
+			d->size = d->size == 0 ? 256 : d->size * 2;
+		}
+		d->data = (char *) realloc(d->data, d->size);
+		assert(d->data != NULL);
+	}
+	memcpy(d->data + d->len, s, len + 1);
+	d->len += len;
+}
+
+static void digest_obj(struct digest *d, struct yocton_object *obj)
+{
+	struct yocton_prop *p;
+
+	while ((p = yocton_next_prop(obj)) != NULL) {
+		digest_append(d, yocton_prop_name(p));
+		if (yocton_prop_type(p) == YOCTON_PROP_OBJECT) {
+			digest_append(d, "{");
+			digest_obj(d, yocton_prop_inner(p));
+			digest_append(d, "}");
+		} else {
+			digest_append(d, ":");
+			digest_append(d, yocton_prop_value(p));
+			digest_append(d, "\n");
+		}
+	}
+}
+
+// Parse the given file and return a string summarizing everything that
+// was read, including any error.
+static char *digest_file(const char *filename)
+{
+	struct digest d = {NULL, 0, 0};
+	struct yocton_object *obj;
+	const char *error_msg;
+	char buf[32];
+	FILE *fstream;
+	int lineno;
+
+	fstream = fopen(filename, "r");
+	assert(fstream != NULL);
+	obj = yocton_read_from(fstream);
+	assert(obj != NULL);
+	digest_append(&d, "");
+	digest_obj(&d, obj);
+	if (yocton_have_error(obj, &lineno, &error_msg)) {
+		snprintf(buf, sizeof(buf), "error on line %d: ", lineno);
+		digest_append(&d, buf);
+		digest_append(&d, error_msg);
+	}
+	yocton_free(obj);
+	fclose(fstream);
+
+	return d.data;
+}
+
+static void *test_thread(void *arg)
+{
+	struct thread_data *data = (struct thread_data *) arg;
+	struct test_state *state = data->state;
+	char *result;
+	int i, j;
+
+	for (i = 0; i < NUM_ITERATIONS; ++i) {
+		for (j = 0; j < state->num_files; ++j) {
+			result = digest_file(state->filenames[j]);
+			if (strcmp(result, state->expected[j]) != 0) {
+				fprintf(stderr, "%s: different result when "
+				        "parsing in thread\n",
+				        state->filenames[j]);
+				data->failed = 1;
+			}
+			free(result);
+		}
+	}
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t threads[NUM_THREADS];
+	struct thread_data data[NUM_THREADS];
+	struct test_state state;
+	int i, failed = 0;
+
+	// Parsing must give the same result regardless of locale.
+	setlocale(LC_ALL, "");
+
+	state.filenames = argv + 1;
+	state.num_files = argc - 1;
+	state.expected = (char **) calloc(argc, sizeof(char *));
+	assert(state.expected != NULL);
+	for (i = 0; i < state.num_files; ++i) {
+		state.expected[i] = digest_file(state.filenames[i]);
+	}
+
+	for (i = 0; i < NUM_THREADS; ++i) {
+		data[i].state = &state;
+		data[i].failed = 0;
+		if (pthread_create(&threads[i], NULL,
+		                   test_thread, &data[i]) != 0) {
+			fprintf(stderr, "failed to create thread\n");
+			exit(1);
+		}
+	}
+	for (i = 0; i < NUM_THREADS; ++i) {
+		pthread_join(threads[i], NULL);
+		failed = failed || data[i].failed;
+	}
+
+	for (i = 0; i < state.num_files; ++i) {
+		free(state.expected[i]);
+	}
+	free(state.expected);
+
+	exit(failed);
+	return 0;
+}
@@ -31,6 +31,9 @@ struct error_data {
 	char *error_message;
 	char *expected_output;
 	int error_lineno;
+	size_t limits[YOCTON_LIMIT_MEMORY + 1];
+	unsigned int flags;
+	size_t buffer_size;
 };
 
 #define ERROR_ALLOC "memory allocation failure"
@@ -70,6 +73,19 @@ void read_error_data(struct error_data *data, struct yocton_object *obj)
 		                  data->error_message);
 		YOCTON_VAR_INT(property, "error_lineno",
 		               int, data->error_lineno);
+		YOCTON_VAR_UINT(property, "limit_string_length", size_t,
+		                data->limits[YOCTON_LIMIT_STRING_LENGTH]);
+		YOCTON_VAR_UINT(property, "limit_depth", size_t,
+		                data->limits[YOCTON_LIMIT_DEPTH]);
+		YOCTON_VAR_UINT(property, "limit_properties", size_t,
+		                data->limits[YOCTON_LIMIT_PROPERTIES]);
+		YOCTON_VAR_UINT(property, "limit_input_size", size_t,
+		                data->limits[YOCTON_LIMIT_INPUT_SIZE]);
+		YOCTON_VAR_UINT(property, "limit_memory", size_t,
+		                data->limits[YOCTON_LIMIT_MEMORY]);
+		YOCTON_VAR_UINT(property, "flags", unsigned int, data->flags);
+		YOCTON_VAR_UINT(property, "buffer_size", size_t,
+		                data->buffer_size);
 	}
 }
 
@@ -273,6 +289,62 @@ static void array_values(struct yocton_object *obj, char **output)
 	free(ptr_items);
 }
 
+// Read a string value a few bytes at a time using yocton_prop_value_read.
+static void stream_value(struct yocton_object *obj, struct yocton_prop *p,
+                         char **output)
+{
+	char buf[6];
+	size_t nbytes;
+
+	while ((nbytes = yocton_prop_value_read(p, buf,
+	                                        sizeof(buf) - 1)) > 0) {
+		buf[nbytes] = '\0';
+		add_output(obj, output, buf);
+	}
+	add_output(obj, output, "\n");
+}
+
+static void base64_value(struct yocton_object *obj, struct yocton_prop *p,
+                         char **output)
+{
+	char *data, *text;
+	size_t len;
+
+	data = (char *) yocton_prop_base64(p, &len);
+	if (data == NULL) {
+		return;
+	}
+	// Decoded test data is always text, so it can be added to output.
+	text = (char *) malloc(len + 1);
+	if (text == NULL) {
+		yocton_check(obj, ERROR_ALLOC, 0);
+		free(data);
+		return;
+	}
+	memcpy(text, data, len);
+	text[len] = '\0';
+	add_output(obj, output, text);
+	add_output(obj, output, "\n");
+	free(text);
+	free(data);
+}
+
+// Simple bitwise CRC32C implementation to check against the parser.
+static uint32_t file_crc32c(FILE *fstream)
+{
+	uint32_t crc = 0xffffffff;
+	int c, i;
+
+	rewind(fstream);
+	while ((c = fgetc(fstream)) != EOF) {
+		crc ^= (uint8_t) c;
+		for (i = 0; i < 8; ++i) {
+			crc = (crc >> 1) ^ ((crc & 1) ? 0x82f63b78 : 0);
+		}
+	}
+	return ~crc;
+}
+
 static char *string_dup(struct yocton_object *obj, const char *value)
 {
 	char *result = strdup(value);
@@ -347,6 +419,24 @@ void evaluate_obj(struct yocton_object *obj, char **output)
 			ptr_value(yocton_prop_inner(property));
 		} else if (!strcmp(name, "special.arrays")) {
 			array_values(yocton_prop_inner(property), output);
+		} else if (!strcmp(name, "special.base64")) {
+			base64_value(obj, property, output);
+		} else if (!strcmp(name, "special.base64_twice")) {
+			base64_value(obj, property, output);
+			base64_value(obj, property, output);
+		} else if (!strcmp(name, "special.checksum_span")) {
+			char buf[16];
+			snprintf(buf, sizeof(buf), "%08x\n",
+			         yocton_prop_checksum(property));
+			add_output(obj, output, buf);
+		} else if (!strcmp(name, "special.stream")) {
+			stream_value(obj, property, output);
+		} else if (!strcmp(name, "special.stream_then_value")) {
+			char buf[4];
+			yocton_prop_value_read(property, buf, sizeof(buf));
+			yocton_prop_value(property);
+		} else if (!strcmp(name, "special.skip")) {
+			// Value is not read at all.
 		} else if (pt == YOCTON_PROP_OBJECT) {
 			evaluate_obj(yocton_prop_inner(property), output);
 		} else {
@@ -363,14 +453,14 @@ void evaluate_obj(struct yocton_object *obj, char **output)
 	}
 }
 
-int run_test_with_limit(char *filename, int alloc_limit)
+int run_test_with_limit(char *filename, int alloc_limit, unsigned int flags)
 {
 	struct error_data error_data = {NULL};
 	struct yocton_object *obj;
 	FILE *fstream;
 	const char *error_msg;
 	char *output;
-	int have_error, lineno, success;
+	int have_error, lineno, success, i;
 
 	assert(alloc_test_get_allocated() == 0);
 	alloc_test_set_limit(-1);
@@ -396,7 +486,24 @@ int run_test_with_limit(char *filename, int alloc_limit)
 		return success;
 	}
 
+	for (i = 0; i <= YOCTON_LIMIT_MEMORY; ++i) {
+		yocton_set_limit(obj, (enum yocton_limit) i,
+		                 error_data.limits[i]);
+	}
+	yocton_set_flags(obj, error_data.flags | flags);
+	if (error_data.buffer_size != 0) {
+		yocton_set_buffer_size(obj, error_data.buffer_size);
+	}
+
 	evaluate_obj(obj, &output);
+
+	if ((error_data.flags & YOCTON_CHECKSUM) != 0
+	 && !yocton_have_error(obj, NULL, NULL)
+	 && yocton_checksum(obj) != file_crc32c(fstream)) {
+		fprintf(stderr, "%s: wrong checksum, want %08x, got %08x\n",
+		        filename, file_crc32c(fstream), yocton_checksum(obj));
+		success = 0;
+	}
 	fclose(fstream);
 
 	have_error = yocton_have_error(obj, &lineno, &error_msg);
@@ -450,8 +557,16 @@ static int run_test(char *filename)
 	int i;
 	int success = 1, test_success;
 
+	// Check the portable versions of the parser's inner loops give the
+	// same result as the ones chosen for this CPU.
+	if (!run_test_with_limit(filename, -1, YOCTON_FORCE_SCALAR)) {
+		fprintf(stderr, "%s: test failed with YOCTON_FORCE_SCALAR\n",
+		        filename);
+		return 0;
+	}
+
 	for (i = -1; i < 50; ++i) {
-		test_success = run_test_with_limit(filename, i);
+		test_success = run_test_with_limit(filename, i, 0);
 		success = success && test_success;
 		// The first time we encounter an error, don't run the test
 		// again. There's no point in spamming stderr for a single
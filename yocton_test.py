@@ -60,7 +60,8 @@ def evaluate_obj(obj, output, s):
 			output.append(value + s("\n"))
 
 def get_file_encoding(filename):
-	if "latin1" in filename:
+	# error-utf8-* files deliberately contain invalid UTF-8.
+	if "latin1" in filename or "error-utf8-" in filename:
 		return "latin1"
 	else:
 		return "utf-8"
@@ -0,0 +1,264 @@
+//
+// Copyright (c) 2022, Simon Howard
+//
+// Permission to use, copy, modify, and/or distribute this software
+// for any purpose with or without fee is hereby granted, provided
+// that the above copyright notice and this permission notice appear
+// in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+// WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+// AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+#include "yocton_zlib.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "yocton.h"
+#include "yoctonw.h"
+
+#define ZLIB_BUF_SIZE (64 * 1024)
+#define ERROR_BUF_SIZE 100
+
+// Adding these to the window size selects the gzip format, or when
+// decompressing, detection of either format.
+#define GZIP_WINDOW_BITS 16
+#define DETECT_WINDOW_BITS 32
+
+struct yoctonw_zlib {
+	z_stream zs;
+	yoctonw_write callback;
+	void *callback_handle;
+	uint8_t *buf;
+	int error, finished;
+};
+
+struct yoctonw_zlib *yoctonw_zlib_new(enum yocton_zlib_format format,
+                                      int level, yoctonw_write callback,
+                                      void *handle)
+{
+	struct yoctonw_zlib *z;
+	int window_bits = MAX_WBITS;
+
+	z = (struct yoctonw_zlib *) calloc(1, sizeof(struct yoctonw_zlib));
+	if (z == NULL) {
+		return NULL;
+	}
+	z->buf = (uint8_t *) malloc(ZLIB_BUF_SIZE);
+	if (z->buf == NULL) {
+		free(z);
+		return NULL;
+	}
+	if (format == YOCTON_ZLIB_FORMAT_GZIP) {
+		window_bits += GZIP_WINDOW_BITS;
+	}
+	if (deflateInit2(&z->zs, level, Z_DEFLATED, window_bits, 8,
+	                 Z_DEFAULT_STRATEGY) != Z_OK) {
+		free(z->buf);
+		free(z);
+		return NULL;
+	}
+	z->callback = callback;
+	z->callback_handle = handle;
+	z->zs.next_out = z->buf;
+	z->zs.avail_out = ZLIB_BUF_SIZE;
+	return z;
+}
+
+// Pass the compressed data in the output buffer to the callback.
+static int write_compressed(struct yoctonw_zlib *z)
+{
+	size_t len = ZLIB_BUF_SIZE - z->zs.avail_out;
+
+	if (len > 0 && !z->callback(z->buf, len, z->callback_handle)) {
+		z->error = 1;
+		return 0;
+	}
+	z->zs.next_out = z->buf;
+	z->zs.avail_out = ZLIB_BUF_SIZE;
+	return 1;
+}
+
+// Compress the given data, writing out compressed data whenever the output
+// buffer fills up. With a flush mode other than Z_NO_FLUSH, everything
+// is written out.
+static int compress_data(struct yoctonw_zlib *z, void *buf, size_t nbytes,
+                         int flush)
+{
+	int status, mode, full;
+
+	if (z->error || z->finished) {
+		return 0;
+	}
+	z->zs.next_in = (Bytef *) buf;
+	do {
+		// avail_in is only 32 bits wide.
+		z->zs.avail_in = nbytes > UINT_MAX ? UINT_MAX : (uInt) nbytes;
+		nbytes -= z->zs.avail_in;
+		mode = nbytes > 0 ? Z_NO_FLUSH : flush;
+		// deflate() only stops early if it runs out of output space.
+		do {
+			status = deflate(&z->zs, mode);
+			if (status == Z_STREAM_ERROR) {
+				z->error = 1;
+				return 0;
+			}
+			full = z->zs.avail_out == 0;
+			if (full && !write_compressed(z)) {
+				return 0;
+			}
+		} while (full);
+	} while (nbytes > 0);
+
+	if (flush != Z_NO_FLUSH) {
+		return write_compressed(z);
+	}
+	return 1;
+}
+
+int yoctonw_zlib_write(void *buf, size_t nbytes, void *handle)
+{
+	return compress_data((struct yoctonw_zlib *) handle, buf, nbytes,
+	                     Z_NO_FLUSH);
+}
+
+int yoctonw_zlib_flush(struct yoctonw_zlib *z)
+{
+	return compress_data(z, NULL, 0, Z_SYNC_FLUSH);
+}
+
+int yoctonw_zlib_finish(struct yoctonw_zlib *z)
+{
+	int result;
+
+	if (z->finished) {
+		return !z->error;
+	}
+	result = compress_data(z, NULL, 0, Z_FINISH);
+	z->finished = 1;
+	return result;
+}
+
+void yoctonw_zlib_free(struct yoctonw_zlib *z)
+{
+	if (z == NULL) {
+		return;
+	}
+	deflateEnd(&z->zs);
+	free(z->buf);
+	free(z);
+}
+
+struct yocton_zlib {
+	z_stream zs;
+	yocton_read callback;
+	void *callback_handle;
+	// Buffer for compressed input; zs.next_in points into it.
+	uint8_t *buf;
+	// Number of streams started so far, and whether we are partway
+	// through one.
+	unsigned int num_streams;
+	int in_stream, eof;
+	char error[ERROR_BUF_SIZE];
+};
+
+struct yocton_zlib *yocton_zlib_new(yocton_read callback, void *handle)
+{
+	struct yocton_zlib *z;
+
+	z = (struct yocton_zlib *) calloc(1, sizeof(struct yocton_zlib));
+	if (z == NULL) {
+		return NULL;
+	}
+	z->buf = (uint8_t *) malloc(ZLIB_BUF_SIZE);
+	if (z->buf == NULL) {
+		free(z);
+		return NULL;
+	}
+	if (inflateInit2(&z->zs, MAX_WBITS + DETECT_WINDOW_BITS) != Z_OK) {
+		free(z->buf);
+		free(z);
+		return NULL;
+	}
+	z->callback = callback;
+	z->callback_handle = handle;
+	return z;
+}
+
+static void zlib_error(struct yocton_zlib *z, const char *msg)
+{
+	snprintf(z->error, sizeof(z->error), "%s", msg);
+}
+
+size_t yocton_zlib_read(void *buf, size_t buf_size, void *handle)
+{
+	struct yocton_zlib *z = (struct yocton_zlib *) handle;
+	uInt out_size = buf_size > UINT_MAX ? UINT_MAX : (uInt) buf_size;
+	int status;
+
+	if (z->eof || strlen(z->error) > 0) {
+		return 0;
+	}
+	// We decompress directly into the caller's buffer, and return as
+	// soon as we have anything to return.
+	z->zs.next_out = (Bytef *) buf;
+	z->zs.avail_out = out_size;
+	while (z->zs.avail_out == out_size) {
+		if (z->zs.avail_in == 0) {
+			z->zs.next_in = z->buf;
+			z->zs.avail_in = (uInt) z->callback(
+			    z->buf, ZLIB_BUF_SIZE, z->callback_handle);
+		}
+		if (z->zs.avail_in == 0) {
+			if (z->in_stream || z->num_streams == 0) {
+				zlib_error(z, "unexpected end of compressed "
+				           "data");
+			}
+			z->eof = 1;
+			break;
+		}
+		if (!z->in_stream) {
+			// Start of another stream after the end of the last.
+			if (z->num_streams > 0 && inflateReset(&z->zs) != Z_OK) {
+				zlib_error(z, "failed to reset decompressor");
+				break;
+			}
+			++z->num_streams;
+			z->in_stream = 1;
+		}
+		status = inflate(&z->zs, Z_NO_FLUSH);
+		if (status == Z_STREAM_END) {
+			z->in_stream = 0;
+		} else if (status != Z_OK && status != Z_BUF_ERROR) {
+			zlib_error(z, z->zs.msg != NULL ? z->zs.msg :
+			           "compressed data is corrupt");
+			break;
+		}
+	}
+	return out_size - z->zs.avail_out;
+}
+
+const char *yocton_zlib_error(struct yocton_zlib *z)
+{
+	return strlen(z->error) > 0 ? z->error : NULL;
+}
+
+void yocton_zlib_free(struct yocton_zlib *z)
+{
+	if (z == NULL) {
+		return;
+	}
+	inflateEnd(&z->zs);
+	free(z->buf);
+	free(z);
+}
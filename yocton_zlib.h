@@ -0,0 +1,193 @@
+//
+// Copyright (c) 2022, Simon Howard
+//
+// Permission to use, copy, modify, and/or distribute this software
+// for any purpose with or without fee is hereby granted, provided
+// that the above copyright notice and this permission notice appear
+// in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+// WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+// AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+#ifndef YOCTON_ZLIB_H
+#define YOCTON_ZLIB_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+
+#include "yocton.h"
+#include "yoctonw.h"
+
+/**
+ * @file yocton_zlib.h
+ *
+ * Adapters for reading and writing compressed Yocton data using zlib.
+ * These are only available if zlib was found at build time.
+ */
+
+/** Format of compressed output. */
+enum yocton_zlib_format {
+	/** zlib format (RFC 1950). */
+	YOCTON_ZLIB_FORMAT_ZLIB,
+
+	/** gzip format (RFC 1952), as used by the gzip tool. */
+	YOCTON_ZLIB_FORMAT_GZIP,
+};
+
+/**
+ * State for compressing output. The output of a writer is compressed by
+ * using @ref yoctonw_zlib_write as its callback.
+ */
+struct yoctonw_zlib;
+
+/**
+ * Create a new compressor that writes compressed data to the given
+ * callback. Example that writes a gzip-compressed file:
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *   struct yoctonw_zlib *z = yoctonw_zlib_new(
+ *       YOCTON_ZLIB_FORMAT_GZIP, 6, fwrite_callback, fs);
+ *   struct yoctonw_writer *w = yoctonw_write_with(yoctonw_zlib_write, z);
+ *   yoctonw_prop(w, "foo", "bar");
+ *   ...
+ *   yoctonw_free(w);
+ *   if (!yoctonw_zlib_finish(z)) {
+ *       // Handle error
+ *   }
+ *   yoctonw_zlib_free(z);
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * @param format    Format of the compressed data.
+ * @param level     Compression level from 1 (fastest) to 9 (smallest
+ *                  output), or -1 for the zlib default.
+ * @param callback  Callback to invoke to write compressed data.
+ * @param handle    Arbitrary pointer passed through when callback is
+ *                  invoked.
+ * @return          New compressor, or NULL on failure.
+ */
+struct yoctonw_zlib *yoctonw_zlib_new(enum yocton_zlib_format format,
+                                      int level, yoctonw_write callback,
+                                      void *handle);
+
+/**
+ * Callback to pass to @ref yoctonw_write_with, to compress the output of
+ * a writer.
+ *
+ * @param buf     Data to compress.
+ * @param nbytes  Length of data in bytes.
+ * @param handle  Pointer to a @ref yoctonw_zlib.
+ * @return        1 for success, or 0 if compression failed or the
+ *                compressed data could not be written.
+ */
+int yoctonw_zlib_write(void *buf, size_t nbytes, void *handle);
+
+/**
+ * Write out all data compressed so far, so that it can be decompressed
+ * by a reader without waiting for the end of the stream. This makes the
+ * output slightly larger, so it should not be done too often; it is
+ * useful for example after writing each record to a log file. Call
+ * @ref yoctonw_flush on the writer first.
+ *
+ * @param z  Compressor.
+ * @return   1 for success, or 0 if an error occurred.
+ */
+int yoctonw_zlib_flush(struct yoctonw_zlib *z);
+
+/**
+ * Finish the compressed stream and write out the remaining data. This
+ * should be called once the writer has been freed with
+ * @ref yoctonw_free.
+ *
+ * @param z  Compressor.
+ * @return   1 for success, or 0 if an error occurred at any point while
+ *           compressing or writing the data.
+ */
+int yoctonw_zlib_finish(struct yoctonw_zlib *z);
+
+/**
+ * Free a compressor.
+ *
+ * @param z  Compressor to free.
+ */
+void yoctonw_zlib_free(struct yoctonw_zlib *z);
+
+/**
+ * State for decompressing input. Compressed input is read by using
+ * @ref yocton_zlib_read as the parser's callback.
+ */
+struct yocton_zlib;
+
+/**
+ * Create a new decompressor that reads compressed data from the given
+ * callback. Both the zlib and gzip formats are accepted, and detected
+ * automatically; input made of several gzip streams one after another,
+ * like the output of `cat a.gz b.gz`, is read as a single stream.
+ *
+ * Data is decompressed straight into the parser's input buffer, so it is
+ * not copied again. It is best to make the parser's buffer larger with
+ * @ref yocton_set_buffer_size. Example that reads a `.yocton.gz` file:
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *   struct yocton_zlib *z = yocton_zlib_new(fread_callback, fs);
+ *   struct yocton_object *obj = yocton_read_with(yocton_zlib_read, z);
+ *   yocton_set_buffer_size(obj, 64 * 1024);
+ *   ...
+ *   if (yocton_zlib_error(z) != NULL) {
+ *       // Handle error
+ *   }
+ *   yocton_free(obj);
+ *   yocton_zlib_free(z);
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * @param callback  Callback to invoke to read compressed data.
+ * @param handle    Arbitrary pointer passed through when callback is
+ *                  invoked.
+ * @return          New decompressor, or NULL on failure.
+ */
+struct yocton_zlib *yocton_zlib_new(yocton_read callback, void *handle);
+
+/**
+ * Callback to pass to @ref yocton_read_with, to decompress the input of a
+ * parser.
+ *
+ * @param buf       Buffer to decompress data into.
+ * @param buf_size  Size of buffer in bytes.
+ * @param handle    Pointer to a @ref yocton_zlib.
+ * @return          Number of bytes decompressed, or zero at the end of the
+ *                  input or if an error occurred.
+ */
+size_t yocton_zlib_read(void *buf, size_t buf_size, void *handle);
+
+/**
+ * Check if the compressed input could not be decompressed. The parser
+ * sees an error as the end of the input, so if the input is corrupt or
+ * truncated, the parser does not always report an error itself; this
+ * should therefore be checked once the input has been read.
+ *
+ * @param z  Decompressor.
+ * @return   Message describing the error, or NULL if there was no error.
+ */
+const char *yocton_zlib_error(struct yocton_zlib *z);
+
+/**
+ * Free a decompressor.
+ *
+ * @param z  Decompressor to free.
+ */
+void yocton_zlib_free(struct yocton_zlib *z);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef YOCTON_ZLIB_H */
@@ -0,0 +1,440 @@
+//
+// Copyright (c) 2022, Simon Howard
+//
+// Permission to use, copy, modify, and/or distribute this software
+// for any purpose with or without fee is hereby granted, provided
+// that the above copyright notice and this permission notice appear
+// in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+// WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+// AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+// Tests for the zlib adapters. Documents are compressed into memory and
+// checked against the same documents written without compression, and
+// read back through the decompressing reader.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <zlib.h>
+
+#include "yocton.h"
+#include "yoctonw.h"
+#include "yocton_zlib.h"
+
+struct output {
+	char *data;
+	size_t len, size;
+};
+
+static int write_to_output(void *buf, size_t nbytes, void *handle)
+{
+	struct output *out = (struct output *) handle;
+
+	if (out->len + nbytes + 1 > out->size) {
+		while (out->len + nbytes + 1 > out->size) {
+			out->size = out->size == 0 ? 256 : out->size * 2;
+		}
+		out->data = (char *) realloc(out->data, out->size);
+		assert(out->data != NULL);
+	}
+	memcpy(out->data + out->len, buf, nbytes);
+	out->len += nbytes;
+	out->data[out->len] = '\0';
+	return 1;
+}
+
+struct input {
+	const char *data;
+	size_t len, offset;
+	// Largest number of bytes to return from one read.
+	size_t max_read;
+};
+
+static size_t read_from_input(void *buf, size_t buf_size, void *handle)
+{
+	struct input *in = (struct input *) handle;
+	size_t n = in->len - in->offset;
+
+	if (n > buf_size) {
+		n = buf_size;
+	}
+	if (n > in->max_read) {
+		n = in->max_read;
+	}
+	memcpy(buf, in->data + in->offset, n);
+	in->offset += n;
+	return n;
+}
+
+static int fail_write(void *buf, size_t nbytes, void *handle)
+{
+	return 0;
+}
+
+// Decompress data using zlib directly, detecting the format.
+static int decompress(struct output *in, struct output *out)
+{
+	z_stream zs;
+	uint8_t buf[1024];
+	int status;
+
+	memset(&zs, 0, sizeof(zs));
+	memset(out, 0, sizeof(*out));
+	status = inflateInit2(&zs, MAX_WBITS + 32);
+	assert(status == Z_OK);
+	zs.next_in = (Bytef *) in->data;
+	zs.avail_in = (uInt) in->len;
+	do {
+		zs.next_out = buf;
+		zs.avail_out = sizeof(buf);
+		status = inflate(&zs, Z_NO_FLUSH);
+		write_to_output(buf, sizeof(buf) - zs.avail_out, out);
+	} while (status == Z_OK && zs.avail_out == 0);
+	inflateEnd(&zs);
+	return status == Z_STREAM_END || status == Z_OK;
+}
+
+// Write a document that is large enough to fill the compressor's buffer
+// several times over.
+static void write_document(struct yoctonw_writer *w, int n)
+{
+	int i;
+
+	for (i = 0; i < n; ++i) {
+		yoctonw_subobject(w, "record");
+		yoctonw_int(w, "id", i);
+		yoctonw_uint(w, "hash", (unsigned long long) i * 2654435761u);
+		yoctonw_prop(w, "name", "a quoted value");
+		yoctonw_end(w);
+	}
+}
+
+static int check_decompressed(const char *test_name, struct output *out,
+                              const char *expected)
+{
+	struct output result;
+	int success = 1;
+
+	if (!decompress(out, &result)) {
+		fprintf(stderr, "%s: failed to decompress output\n",
+		        test_name);
+		success = 0;
+	} else if (result.data == NULL || strcmp(result.data, expected) != 0) {
+		fprintf(stderr, "%s: wrong output after decompressing\n",
+		        test_name);
+		success = 0;
+	}
+	free(result.data);
+	return success;
+}
+
+static int test_write(void)
+{
+	struct yoctonw_writer *w;
+	struct yoctonw_zlib *z;
+	struct output plain, out;
+	int format, success = 1;
+
+	memset(&plain, 0, sizeof(plain));
+	w = yoctonw_write_with(write_to_output, &plain);
+	write_document(w, 20000);
+	yoctonw_free(w);
+
+	for (format = YOCTON_ZLIB_FORMAT_ZLIB;
+	     format <= YOCTON_ZLIB_FORMAT_GZIP; ++format) {
+		memset(&out, 0, sizeof(out));
+		z = yoctonw_zlib_new((enum yocton_zlib_format) format, 1,
+		                     write_to_output, &out);
+		assert(z != NULL);
+		w = yoctonw_write_with(yoctonw_zlib_write, z);
+		write_document(w, 20000);
+		yoctonw_free(w);
+		if (!yoctonw_zlib_finish(z)) {
+			fprintf(stderr, "test_write: unexpected error\n");
+			success = 0;
+		}
+		yoctonw_zlib_free(z);
+
+		if (out.len >= plain.len / 4) {
+			fprintf(stderr, "test_write: output not compressed\n");
+			success = 0;
+		}
+		if (format == YOCTON_ZLIB_FORMAT_GZIP
+		 && (out.len < 2 || (uint8_t) out.data[0] != 0x1f
+		  || (uint8_t) out.data[1] != 0x8b)) {
+			fprintf(stderr, "test_write: no gzip header\n");
+			success = 0;
+		}
+		success = check_decompressed("test_write", &out, plain.data)
+		       && success;
+		free(out.data);
+	}
+	free(plain.data);
+	return success;
+}
+
+static int test_flush(void)
+{
+	struct yoctonw_writer *w;
+	struct yoctonw_zlib *z;
+	struct output out;
+	int success;
+
+	// Everything written before a flush can be decompressed.
+	memset(&out, 0, sizeof(out));
+	z = yoctonw_zlib_new(YOCTON_ZLIB_FORMAT_GZIP, -1,
+	                     write_to_output, &out);
+	assert(z != NULL);
+	w = yoctonw_write_with(yoctonw_zlib_write, z);
+	yoctonw_prop(w, "first", "record");
+	yoctonw_flush(w);
+	success = yoctonw_zlib_flush(z);
+	success = check_decompressed("test_flush", &out, "first: record\n")
+	       && success;
+	yoctonw_prop(w, "second", "record");
+	yoctonw_free(w);
+	success = yoctonw_zlib_finish(z) && success;
+	yoctonw_zlib_free(z);
+	success = check_decompressed("test_flush", &out,
+	                             "first: record\nsecond: record\n")
+	       && success;
+	free(out.data);
+	return success;
+}
+
+static int test_write_error(void)
+{
+	struct yoctonw_writer *w;
+	struct yoctonw_zlib *z;
+	int success = 1;
+
+	z = yoctonw_zlib_new(YOCTON_ZLIB_FORMAT_ZLIB, -1, fail_write, NULL);
+	assert(z != NULL);
+	w = yoctonw_write_with(yoctonw_zlib_write, z);
+	write_document(w, 20000);
+	if (!yoctonw_have_error(w)) {
+		fprintf(stderr, "test_write_error: error not reported to "
+		        "writer\n");
+		success = 0;
+	}
+	yoctonw_free(w);
+	if (yoctonw_zlib_finish(z)) {
+		fprintf(stderr, "test_write_error: error not reported\n");
+		success = 0;
+	}
+	yoctonw_zlib_free(z);
+	return success;
+}
+
+// Summarize everything read from the given object as a string.
+static void digest_obj(struct output *d, struct yocton_object *obj)
+{
+	struct yocton_prop *p;
+	const char *s;
+
+	while ((p = yocton_next_prop(obj)) != NULL) {
+		s = yocton_prop_name(p);
+		write_to_output((void *) s, strlen(s), d);
+		if (yocton_prop_type(p) == YOCTON_PROP_OBJECT) {
+			write_to_output("{", 1, d);
+			digest_obj(d, yocton_prop_inner(p));
+			write_to_output("}", 1, d);
+		} else {
+			s = yocton_prop_value(p);
+			write_to_output(":", 1, d);
+			write_to_output((void *) s, strlen(s), d);
+			write_to_output("\n", 1, d);
+		}
+	}
+}
+
+static void compress_document(struct output *out,
+                              enum yocton_zlib_format format, int n)
+{
+	struct yoctonw_writer *w;
+	struct yoctonw_zlib *z;
+
+	z = yoctonw_zlib_new(format, -1, write_to_output, out);
+	assert(z != NULL);
+	w = yoctonw_write_with(yoctonw_zlib_write, z);
+	write_document(w, n);
+	yoctonw_free(w);
+	if (!yoctonw_zlib_finish(z)) {
+		fprintf(stderr, "compress_document: failed to finish "
+		        "stream\n");
+		exit(1);
+	}
+	yoctonw_zlib_free(z);
+}
+
+// Read compressed data and summarize what was read. Returns the
+// decompressor's error, if any, or "parse error".
+static const char *read_compressed(struct output *compressed,
+                                   size_t max_read, struct output *digest)
+{
+	struct yocton_object *obj;
+	struct yocton_zlib *z;
+	struct input in;
+	static char error[100];
+	const char *result = NULL;
+
+	in.data = compressed->data;
+	in.len = compressed->len;
+	in.offset = 0;
+	in.max_read = max_read;
+	memset(digest, 0, sizeof(*digest));
+	z = yocton_zlib_new(read_from_input, &in);
+	assert(z != NULL);
+	obj = yocton_read_with(yocton_zlib_read, z);
+	assert(obj != NULL);
+	yocton_set_buffer_size(obj, 64 * 1024);
+	digest_obj(digest, obj);
+	if (yocton_zlib_error(z) != NULL) {
+		snprintf(error, sizeof(error), "%s", yocton_zlib_error(z));
+		result = error;
+	} else if (yocton_have_error(obj, NULL, NULL)) {
+		result = "parse error";
+	}
+	yocton_free(obj);
+	yocton_zlib_free(z);
+	return result;
+}
+
+static int test_read(void)
+{
+	struct yoctonw_writer *w;
+	struct yocton_object *obj;
+	struct output plain, out, expected, digest;
+	struct input in;
+	const char *error;
+	int format, success = 1;
+
+	memset(&plain, 0, sizeof(plain));
+	w = yoctonw_write_with(write_to_output, &plain);
+	write_document(w, 20000);
+	yoctonw_free(w);
+	in.data = plain.data;
+	in.len = plain.len;
+	in.offset = 0;
+	in.max_read = plain.len;
+	memset(&expected, 0, sizeof(expected));
+	obj = yocton_read_with(read_from_input, &in);
+	digest_obj(&expected, obj);
+	yocton_free(obj);
+
+	for (format = YOCTON_ZLIB_FORMAT_ZLIB;
+	     format <= YOCTON_ZLIB_FORMAT_GZIP; ++format) {
+		memset(&out, 0, sizeof(out));
+		compress_document(&out, (enum yocton_zlib_format) format,
+		                  20000);
+		// Input arriving in small pieces is handled the same.
+		error = read_compressed(&out, 100, &digest);
+		if (error != NULL) {
+			fprintf(stderr, "test_read: error: %s\n", error);
+			success = 0;
+		} else if (strcmp(digest.data, expected.data) != 0) {
+			fprintf(stderr, "test_read: wrong result\n");
+			success = 0;
+		}
+		free(digest.data);
+		error = read_compressed(&out, out.len, &digest);
+		if (error != NULL || strcmp(digest.data, expected.data) != 0) {
+			fprintf(stderr, "test_read: wrong result\n");
+			success = 0;
+		}
+		free(digest.data);
+		free(out.data);
+	}
+	free(plain.data);
+	free(expected.data);
+	return success;
+}
+
+static int test_read_concatenated(void)
+{
+	struct output out, digest;
+	const char *error;
+	int success = 1;
+
+	// Two gzip streams one after another read as one.
+	memset(&out, 0, sizeof(out));
+	compress_document(&out, YOCTON_ZLIB_FORMAT_GZIP, 1);
+	compress_document(&out, YOCTON_ZLIB_FORMAT_GZIP, 1);
+	error = read_compressed(&out, out.len, &digest);
+	if (error != NULL || digest.data == NULL
+	 || strcmp(digest.data, "record{id:0\nhash:0\nname:a quoted value\n}"
+	                        "record{id:0\nhash:0\nname:a quoted value\n}")
+	    != 0) {
+		fprintf(stderr, "test_read_concatenated: wrong result\n");
+		success = 0;
+	}
+	free(digest.data);
+	free(out.data);
+	return success;
+}
+
+static int test_read_error(void)
+{
+	struct output out, digest;
+	int success = 1;
+
+	memset(&out, 0, sizeof(out));
+	compress_document(&out, YOCTON_ZLIB_FORMAT_GZIP, 1000);
+
+	// Truncated data is reported, even if it ends between properties.
+	out.len /= 2;
+	if (read_compressed(&out, out.len, &digest) == NULL) {
+		fprintf(stderr, "test_read_error: truncation not reported\n");
+		success = 0;
+	}
+	free(digest.data);
+
+	// Corrupt data.
+	out.data[out.len / 2] ^= 0x55;
+	if (read_compressed(&out, out.len, &digest) == NULL) {
+		fprintf(stderr, "test_read_error: corruption not reported\n");
+		success = 0;
+	}
+	free(digest.data);
+
+	// Empty input.
+	if (read_compressed(&out, 0, &digest) == NULL) {
+		fprintf(stderr, "test_read_error: empty input not reported\n");
+		success = 0;
+	}
+	free(digest.data);
+	free(out.data);
+	return success;
+}
+
+static int (*tests[])(void) = {
+	test_write,
+	test_flush,
+	test_write_error,
+	test_read,
+	test_read_concatenated,
+	test_read_error,
+	NULL,
+};
+
+int main(int argc, char *argv[])
+{
+	int i;
+	int success = 1;
+
+	for (i = 0; tests[i] != NULL; i++) {
+		success = tests[i]() && success;
+	}
+
+	exit(!success);
+	return 0;
+}
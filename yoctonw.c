@@ -17,16 +17,55 @@
 //
 
 #include "yoctonw.h"
+#include "yocton.h"
+#include "yocton_kernels.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
-#include <ctype.h>
 #include <inttypes.h>
 
+// For writers using a writev callback, values at least this long are
+// referenced in place rather than being copied into the buffer.
+#define MIN_REFERENCE_LEN 256
+
+// Maximum number of segments passed to a writev callback at once.
+#define MAX_SEGMENTS 64
+
+// Smallest record buffer for a writer created with yoctonw_write_to_ring().
+#define MIN_RING_RECORD_SIZE 64
+
+// The ring buffer indexes are shared between a writer and a reader
+// thread, so need to be accessed atomically.
+#ifdef __GNUC__
+#define RING_LOAD(x)      __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define RING_STORE(x, v)  __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#else
+#define RING_LOAD(x)      (x)
+#define RING_STORE(x, v)  ((x) = (v))
+#endif
+
+// Part of the output for a writev callback: either a reference to data in
+// caller memory, or if data is NULL, buf[offset:offset+len].
+struct segment {
+	const uint8_t *data;
+	size_t offset, len;
+};
+
+struct yoctonw_fragment {
+	char *data;
+	size_t len;
+	// Whether the fragment was written in compact mode, and if so,
+	// whether it ends with a bare string.
+	int compact, need_space;
+};
+
 struct yoctonw_writer {
+	// If neither callback is set, output accumulates in buf, which
+	// grows as needed (see yoctonw_write_to_buffer).
 	yoctonw_write callback;
+	yoctonw_writev writev_callback;
 	void *callback_handle;
 	uint8_t *buf;
 	size_t buf_len, buf_size;
@@ -34,6 +73,36 @@ struct yoctonw_writer {
 	size_t printf_buf_size;
 	int indent_level;
 	int error;
+	const struct yocton_kernels *kernels;
+	// Set with yoctonw_set_flush_policy().
+	enum yoctonw_flush_policy flush_policy;
+	size_t flush_threshold;
+	// Output to pass to writev_callback on the next flush, in addition to
+	// buf[segments_end:buf_len]. References to caller memory are only
+	// valid until the call that added them returns, so are always
+	// flushed before then.
+	struct segment segments[MAX_SEGMENTS];
+	struct yoctonw_iovec iov[MAX_SEGMENTS + 1];
+	int num_segments, num_references;
+	size_t segments_end, references_len;
+	// Total bytes of output, not including what is still in buf or
+	// referenced by segments. If measure_only is set, output is only
+	// counted here and not stored.
+	size_t output_size;
+	int measure_only;
+	// Set with yoctonw_set_flags(). In compact mode, need_space is set
+	// if the last thing written was a bare string, so a space is needed
+	// before the next property name.
+	unsigned int flags;
+	int need_space;
+	// For child writers, the indent level of the parent when the child
+	// was created; subobjects cannot be ended beyond this level.
+	int base_indent_level;
+	// For writers created with yoctonw_write_to_ring(), output goes to
+	// ring, and the writer and buf are in caller memory. If the current
+	// record does not fit in buf, record_dropped is set.
+	struct yoctonw_ring *ring;
+	int record_dropped;
 };
 
 struct yoctonw_writer *yoctonw_write_with(yoctonw_write callback, void *handle)
@@ -54,6 +123,7 @@ struct yoctonw_writer *yoctonw_write_with(yoctonw_write callback, void *handle)
 	writer->buf = (uint8_t *) calloc(writer->buf_size, sizeof(char));
 	writer->printf_buf = NULL;
 	writer->printf_buf_size = 0;
+	writer->kernels = __yocton_kernels(0);
 	if (writer->buf == NULL) {
 		free(writer);
 		return NULL;
@@ -62,6 +132,114 @@ struct yoctonw_writer *yoctonw_write_with(yoctonw_write callback, void *handle)
 	return writer;
 }
 
+struct yoctonw_writer *yoctonw_writev_with(yoctonw_writev callback,
+                                           void *handle)
+{
+	struct yoctonw_writer *writer = yoctonw_write_with(NULL, handle);
+
+	if (writer != NULL) {
+		writer->writev_callback = callback;
+	}
+	return writer;
+}
+
+struct yoctonw_writer *yoctonw_write_to_buffer(void)
+{
+	return yoctonw_write_with(NULL, NULL);
+}
+
+void yoctonw_ring_init(struct yoctonw_ring *ring, void *data, size_t size)
+{
+	ring->data = (uint8_t *) data;
+	ring->size = size;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->dropped = 0;
+}
+
+struct yoctonw_writer *yoctonw_write_to_ring(struct yoctonw_ring *ring,
+                                             void *mem, size_t mem_size)
+{
+	struct yoctonw_writer *writer;
+	uintptr_t addr = (uintptr_t) mem, aligned;
+
+	// The writer itself goes at the start of the memory, suitably
+	// aligned, and the rest is used as the record buffer.
+	aligned = (addr + sizeof(void *) - 1)
+	        & ~(uintptr_t) (sizeof(void *) - 1);
+	if (mem_size < (aligned - addr) + sizeof(struct yoctonw_writer)
+	             + MIN_RING_RECORD_SIZE) {
+		return NULL;
+	}
+	writer = (struct yoctonw_writer *) aligned;
+	memset(writer, 0, sizeof(struct yoctonw_writer));
+	writer->ring = ring;
+	writer->buf = (uint8_t *) (writer + 1);
+	writer->buf_size = mem_size - (aligned - addr)
+	                 - sizeof(struct yoctonw_writer);
+	writer->kernels = __yocton_kernels(0);
+	writer->flush_policy = YOCTONW_FLUSH_PROPERTY;
+	return writer;
+}
+
+// Copy a complete record into the ring, or drop it if it does not fit.
+static void ring_commit(struct yoctonw_ring *ring, const uint8_t *data,
+                        size_t len)
+{
+	size_t head = ring->head, offset, n;
+
+	if (ring->size == 0
+	 || len > ring->size - (head - RING_LOAD(ring->tail))) {
+		RING_STORE(ring->dropped, ring->dropped + 1);
+		return;
+	}
+	offset = head % ring->size;
+	n = ring->size - offset < len ? ring->size - offset : len;
+	memcpy(ring->data + offset, data, n);
+	memcpy(ring->data, data + n, len - n);
+	RING_STORE(ring->head, head + len);
+}
+
+size_t yoctonw_ring_read(struct yoctonw_ring *ring, void *buf,
+                         size_t buf_size)
+{
+	size_t tail = ring->tail, offset, len, n;
+
+	if (ring->size == 0) {
+		return 0;
+	}
+	len = RING_LOAD(ring->head) - tail;
+	if (len > buf_size) {
+		len = buf_size;
+	}
+	offset = tail % ring->size;
+	n = ring->size - offset < len ? ring->size - offset : len;
+	memcpy(buf, ring->data + offset, n);
+	memcpy((uint8_t *) buf + n, ring->data, len - n);
+	RING_STORE(ring->tail, tail + len);
+	return len;
+}
+
+size_t yoctonw_ring_dropped(struct yoctonw_ring *ring)
+{
+	return RING_LOAD(ring->dropped);
+}
+
+struct yoctonw_writer *yoctonw_measure(void)
+{
+	struct yoctonw_writer *writer = yoctonw_write_with(NULL, NULL);
+
+	if (writer != NULL) {
+		writer->measure_only = 1;
+	}
+	return writer;
+}
+
+size_t yoctonw_size(struct yoctonw_writer *w)
+{
+	return w->output_size + w->buf_len + w->references_len;
+}
+
 static int fwrite_wrapper(void *buf, size_t nbytes, void *handle)
 {
 	return fwrite(buf, 1, nbytes, (FILE *) handle) == nbytes;
@@ -74,140 +252,1261 @@ struct yoctonw_writer *yoctonw_write_to(FILE *fstream)
 
 void yoctonw_free(struct yoctonw_writer *writer)
 {
+	yoctonw_flush(writer);
+	// Ring writers are in caller memory.
+	if (writer->ring != NULL) {
+		return;
+	}
 	free(writer->printf_buf);
 	free(writer->buf);
 	free(writer);
 }
 
+// Common part of yoctonw_reset() and yoctonw_reset_writev(). Returns -1
+// if the writer could not be reset, otherwise 1, or 0 if output since the
+// last reset could not all be written.
+static int reset_writer(struct yoctonw_writer *w)
+{
+	int result;
+
+	if (w->ring != NULL) {
+		return -1;
+	}
+	yoctonw_flush(w);
+	result = !w->error;
+	// Output that could not be flushed would otherwise be lost: either
+	// an in-memory buffer that has not been taken, or an unfinished
+	// record with the YOCTONW_FLUSH_RECORD policy. After an error it
+	// can never be written, so it is thrown away.
+	if (!w->error && (w->buf_len > 0 || w->num_segments > 0)) {
+		return -1;
+	}
+	// The buffer may have been taken with yoctonw_take_buffer().
+	if (w->buf == NULL) {
+		w->buf = (uint8_t *) malloc(256);
+		if (w->buf == NULL) {
+			return -1;
+		}
+		w->buf_size = 256;
+	}
+	w->buf_len = 0;
+	w->num_segments = 0;
+	w->num_references = 0;
+	w->segments_end = 0;
+	w->references_len = 0;
+	w->indent_level = 0;
+	w->base_indent_level = 0;
+	w->error = 0;
+	w->output_size = 0;
+	w->measure_only = 0;
+	w->need_space = w->flush_policy == YOCTONW_FLUSH_RECORD;
+	return result;
+}
+
+int yoctonw_reset(struct yoctonw_writer *w, yoctonw_write callback,
+                  void *handle)
+{
+	int result = reset_writer(w);
+
+	if (result < 0) {
+		return 0;
+	}
+	w->callback = callback;
+	w->writev_callback = NULL;
+	w->callback_handle = handle;
+	return result;
+}
+
+int yoctonw_reset_writev(struct yoctonw_writer *w, yoctonw_writev callback,
+                         void *handle)
+{
+	int result = reset_writer(w);
+
+	if (result < 0) {
+		return 0;
+	}
+	w->callback = NULL;
+	w->writev_callback = callback;
+	w->callback_handle = handle;
+	return result;
+}
+
+static int flush_segments(struct yoctonw_writer *w)
+{
+	struct segment *seg;
+	int i;
+
+	for (i = 0; i < w->num_segments; ++i) {
+		seg = &w->segments[i];
+		w->iov[i].base = seg->data != NULL ?
+		    seg->data : w->buf + seg->offset;
+		w->iov[i].len = seg->len;
+	}
+	if (w->buf_len > w->segments_end) {
+		w->iov[i].base = w->buf + w->segments_end;
+		w->iov[i].len = w->buf_len - w->segments_end;
+		++i;
+	}
+	return w->writev_callback(w->iov, i, w->callback_handle);
+}
+
 void yoctonw_flush(struct yoctonw_writer *w)
 {
 	int success;
 
-	if (w->buf_len == 0) {
+	if (w->ring != NULL) {
+		// Only whole records are written to the ring.
+		if (w->indent_level > 0) {
+			return;
+		}
+		if (w->record_dropped) {
+			RING_STORE(w->ring->dropped, w->ring->dropped + 1);
+		} else if (w->buf_len > 0) {
+			ring_commit(w->ring, w->buf, w->buf_len);
+		}
+		w->output_size += w->buf_len;
+		w->buf_len = 0;
+		w->record_dropped = 0;
+		return;
+	} else if (w->buf_len == 0 && w->num_segments == 0) {
+		return;
+	} else if (w->callback == NULL && w->writev_callback == NULL) {
+		// Output stays in the in-memory buffer.
+		return;
+	} else if (w->flush_policy == YOCTONW_FLUSH_RECORD
+	        && w->indent_level > 0) {
+		// Only whole records are flushed.
 		return;
 	}
-	if (w->error) {
+	if (!w->error) {
+		if (w->writev_callback != NULL) {
+			success = flush_segments(w);
+		} else {
+			success = w->callback(w->buf, w->buf_len,
+			                      w->callback_handle);
+		}
+		if (!success) {
+			w->error = 1;
+		}
+	}
+	w->output_size += w->buf_len + w->references_len;
+	w->buf_len = 0;
+	w->num_segments = 0;
+	w->num_references = 0;
+	w->segments_end = 0;
+	w->references_len = 0;
+	// The next record may follow a bare string from another writer.
+	if (w->flush_policy == YOCTONW_FLUSH_RECORD) {
+		w->need_space = 1;
+	}
+}
+
+void yoctonw_set_flags(struct yoctonw_writer *w, unsigned int flags)
+{
+	w->flags = flags;
+}
+
+void yoctonw_set_flush_policy(struct yoctonw_writer *w,
+                              enum yoctonw_flush_policy policy,
+                              size_t threshold)
+{
+	w->flush_policy = policy;
+	w->flush_threshold = threshold;
+	if (policy == YOCTONW_FLUSH_RECORD) {
+		w->need_space = 1;
+	}
+}
+
+static int resize_buffer(struct yoctonw_writer *w, size_t size)
+{
+	uint8_t *new_buf;
+
+	new_buf = (uint8_t *) realloc(w->buf, size);
+	if (new_buf == NULL) {
+		return 0;
+	}
+	w->buf = new_buf;
+	w->buf_size = size;
+	return 1;
+}
+
+int yoctonw_set_buffer_size(struct yoctonw_writer *w, size_t size)
+{
+	if (size == 0 || w->ring != NULL) {
+		return 0;
+	}
+	if (size < w->buf_len) {
+		yoctonw_flush(w);
+	}
+	// Data cannot be flushed from an in-memory buffer.
+	if (size < w->buf_len) {
+		return 0;
+	}
+	return resize_buffer(w, size);
+}
+
+char *yoctonw_take_buffer(struct yoctonw_writer *w, size_t *len)
+{
+	char *result;
+
+	if (w->error || w->measure_only || w->ring != NULL
+	 || w->callback != NULL || w->writev_callback != NULL) {
+		return NULL;
+	}
+	// There is always space for the terminating NUL.
+	if (w->buf_len >= w->buf_size && !resize_buffer(w, w->buf_len + 1)) {
+		return NULL;
+	}
+	w->buf[w->buf_len] = '\0';
+	result = (char *) w->buf;
+	if (len != NULL) {
+		*len = w->buf_len;
+	}
+	w->output_size += w->buf_len;
+	// A new buffer is allocated when more output is written.
+	w->buf = NULL;
+	w->buf_len = 0;
+	w->buf_size = 0;
+	return result;
+}
+
+// Called when the output buffer is full, to make space for more data.
+static void buffer_full(struct yoctonw_writer *w)
+{
+	if (w->ring != NULL) {
+		// The record buffer cannot grow, so the record is dropped
+		// and the rest of it is written over the start of the buffer.
+		w->record_dropped = 1;
+		w->buf_len = 0;
+	} else if (w->flush_policy != YOCTONW_FLUSH_EXPLICIT
+	        && w->flush_policy != YOCTONW_FLUSH_RECORD
+	        && (w->callback != NULL || w->writev_callback != NULL)) {
+		yoctonw_flush(w);
+	} else if (!resize_buffer(w, w->buf_size == 0 ?
+	                             256 : w->buf_size * 2)) {
+		w->error = 1;
 		w->buf_len = 0;
+	}
+}
+
+// Called at the end of each call that writes a property, or starts or ends
+// a subobject.
+static void end_of_prop(struct yoctonw_writer *w)
+{
+	// Caller memory can be freed once we return.
+	if (w->num_references > 0) {
+		yoctonw_flush(w);
 		return;
 	}
-	success = w->callback(w->buf, w->buf_len, w->callback_handle);
-	if (!success) {
-		w->error = 1;
+	if (w->indent_level != 0) {
+		return;
+	}
+	switch (w->flush_policy) {
+		case YOCTONW_FLUSH_PROPERTY:
+		case YOCTONW_FLUSH_RECORD:
+			yoctonw_flush(w);
+			break;
+		case YOCTONW_FLUSH_THRESHOLD:
+			if (w->buf_len >= w->flush_threshold) {
+				yoctonw_flush(w);
+			}
+			break;
+		default:
+			break;
 	}
-	w->buf_len = 0;
 }
 
 static inline void insert_char(struct yoctonw_writer *w, uint8_t c)
 {
+	if (w->measure_only) {
+		++w->output_size;
+		return;
+	}
 	if (w->buf_len >= w->buf_size) {
-		yoctonw_flush(w);
+		buffer_full(w);
 	}
 	w->buf[w->buf_len] = c;
 	++w->buf_len;
 }
 
-static int is_bare_string(const char *s)
+// Append a run of bytes, flushing as many times as needed.
+static void write_bytes(struct yoctonw_writer *w, const void *data, size_t len)
 {
-	int i;
+	const uint8_t *d = (const uint8_t *) data;
+	size_t n;
 
-	for (i = 0; s[i] != '\0'; i++) {
-		if (!isalnum(s[i]) && strchr("_-+.", s[i]) == NULL) {
-			return 0;
+	if (w->measure_only) {
+		w->output_size += len;
+		return;
+	}
+	while (len > 0) {
+		if (w->buf_len >= w->buf_size) {
+			buffer_full(w);
+		}
+		n = w->buf_size - w->buf_len;
+		if (n > len) {
+			n = len;
 		}
+		memcpy(w->buf + w->buf_len, d, n);
+		w->buf_len += n;
+		d += n;
+		len -= n;
 	}
+}
 
-	return 1;
+// Write a run of bytes that is part of a name or value, which may be
+// referenced in place instead of being copied.
+static void write_value_bytes(struct yoctonw_writer *w, const uint8_t *data,
+                              size_t len)
+{
+	struct segment *seg;
+
+	// References must be flushed before we return, which cannot be
+	// done in the middle of a record.
+	if (w->writev_callback == NULL || len < MIN_REFERENCE_LEN
+	 || w->flush_policy == YOCTONW_FLUSH_RECORD) {
+		write_bytes(w, data, len);
+		return;
+	}
+	if (w->num_segments + 2 > MAX_SEGMENTS) {
+		yoctonw_flush(w);
+	}
+	// Anything written to the buffer since the last reference goes
+	// first, then the reference.
+	if (w->buf_len > w->segments_end) {
+		seg = &w->segments[w->num_segments];
+		seg->data = NULL;
+		seg->offset = w->segments_end;
+		seg->len = w->buf_len - w->segments_end;
+		++w->num_segments;
+		w->segments_end = w->buf_len;
+	}
+	seg = &w->segments[w->num_segments];
+	seg->data = data;
+	seg->len = len;
+	++w->num_segments;
+	++w->num_references;
+	w->references_len += len;
 }
 
-static void write_string(struct yoctonw_writer *w, const char *s)
+// Characters that are valid in a bare (unquoted) string. We use a fixed
+// table rather than <ctype.h>, since isalnum() depends on the locale.
+static const uint8_t symbol_chars[256] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1, 1, 0,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+	0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 1,
+	0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+	// All bytes >= 0x80 are zero.
+};
+
+
+static void write_escape(struct yoctonw_writer *w, uint8_t c)
 {
-	int i, c;
-	char hex[3];
+	static const char hex_digits[] = "0123456789abcdef";
+	char escape[4];
 
-	if (strlen(s) > 0 && is_bare_string(s)) {
-		for (i = 0; s[i] != '\0'; ++i) {
-			insert_char(w, s[i]);
-		}
+	// NUL cannot be represented, even as an escape sequence.
+	if (c == '\0') {
+		w->error = 1;
 		return;
 	}
+	escape[0] = '\\';
+	switch (c) {
+		case '\n': escape[1] = 'n'; break;
+		case '\t': escape[1] = 't'; break;
+		case '\\': escape[1] = '\\'; break;
+		case '\"': escape[1] = '\"'; break;
+		default:
+			escape[1] = 'x';
+			escape[2] = hex_digits[c >> 4];
+			escape[3] = hex_digits[c & 0xf];
+			write_bytes(w, escape, 4);
+			return;
+	}
+	write_bytes(w, escape, 2);
+}
+
+// Write a string, quoted and escaped if it cannot be written bare. The
+// string is only scanned once: the prefix of symbol characters found when
+// checking if it can be bare never needs escaping. Returns non-zero if the
+// string was written bare.
+static int write_string(struct yoctonw_writer *w, const char *s, size_t len)
+{
+	const uint8_t *data = (const uint8_t *) s;
+	size_t i, prefix, span;
+
+	for (prefix = 0; prefix < len && symbol_chars[data[prefix]]; ++prefix);
+	if (len > 0 && prefix == len) {
+		write_value_bytes(w, data, len);
+		return 1;
+	}
 
-	// Some characters need escaping:
+	// Copy runs of characters that do not need escaping in one go. The
+	// prefix we already scanned is the start of the first run.
 	insert_char(w, '"');
-	for (i = 0; s[i] != '\0'; i++) {
-		c = s[i];
-		switch (c) {
-		case '\n': insert_char(w, '\\'); insert_char(w, 'n'); break;
-		case '\t': insert_char(w, '\\'); insert_char(w, 't'); break;
-		case '\\': insert_char(w, '\\'); insert_char(w, '\\'); break;
-		case '\"': insert_char(w, '\\'); insert_char(w, '\"'); break;
-		default:
-			if (c >= 0x20) {
-				insert_char(w, c);
-				break;
-			}
-			snprintf(hex, sizeof(hex), "%02x", c);
-			insert_char(w, '\\');
-			insert_char(w, 'x');
-			insert_char(w, hex[0]);
-			insert_char(w, hex[1]);
-			break;
+	for (i = 0; i < len; ++i) {
+		span = prefix + w->kernels->string_span(
+		    data + i + prefix, len - i - prefix, 0);
+		prefix = 0;
+		write_value_bytes(w, data + i, span);
+		i += span;
+		if (i < len) {
+			write_escape(w, data[i]);
 		}
 	}
 	insert_char(w, '"');
+	return 0;
+}
+
+static void write_tabs(struct yoctonw_writer *w, size_t count)
+{
+	static const char tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+	size_t n, remaining = count;
+
+	while (remaining > 0) {
+		n = remaining < sizeof(tabs) - 1 ? remaining : sizeof(tabs) - 1;
+		write_bytes(w, tabs, n);
+		remaining -= n;
+	}
 }
 
 static void write_indent(struct yoctonw_writer *w)
 {
-	int i;
-	for (i = 0; i < w->indent_level; i++) {
-		insert_char(w, '\t');
+	write_tabs(w, (size_t) w->indent_level);
+}
+
+// Write the name at the start of a property or subobject, along with the
+// indentation before it, or in compact mode, any space needed to separate
+// it from the previous property.
+static void write_name(struct yoctonw_writer *w, const char *name,
+                       size_t name_len)
+{
+	if ((w->flags & YOCTONW_COMPACT) == 0) {
+		write_indent(w);
+	} else if (w->need_space) {
+		insert_char(w, ' ');
+	}
+	write_string(w, name, name_len);
+	insert_char(w, ':');
+	if ((w->flags & YOCTONW_COMPACT) == 0) {
+		insert_char(w, ' ');
+	}
+}
+
+// Finish a property after writing its value.
+static void end_value(struct yoctonw_writer *w, int bare)
+{
+	if ((w->flags & YOCTONW_COMPACT) == 0) {
+		insert_char(w, '\n');
 	}
+	w->need_space = bare;
 }
 
 void yoctonw_prop(struct yoctonw_writer *w, const char *name,
                    const char *value)
+{
+	yoctonw_prop_n(w, name, strlen(name), value, strlen(value));
+}
+
+void yoctonw_prop_n(struct yoctonw_writer *w, const char *name,
+                    size_t name_len, const char *value, size_t value_len)
 {
 	if (w->error) {
 		return;
 	}
-	write_indent(w);
-	write_string(w, name);
-	insert_char(w, ':');
-	insert_char(w, ' ');
-	write_string(w, value);
-	insert_char(w, '\n');
-	// We flush after every top-level def is completed; this means
-	// output will always have been flushed before writer is freed.
-	if (w->indent_level == 0) {
-		yoctonw_flush(w);
+	write_name(w, name, name_len);
+	end_value(w, write_string(w, value, value_len));
+	end_of_prop(w);
+}
+
+void yoctonw_base64(struct yoctonw_writer *w, const char *name,
+                    const void *data, size_t len)
+{
+	static const char base64_chars[] =
+	    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	const uint8_t *d = (const uint8_t *) data;
+	char out[64];
+	size_t i, out_len = 0;
+	uint32_t v;
+
+	if (w->error) {
+		return;
+	}
+	write_name(w, name, strlen(name));
+	// Base64 never needs any characters escaping, but may contain
+	// characters that are not valid in a bare string.
+	insert_char(w, '"');
+	for (i = 0; i + 3 <= len; i += 3) {
+		v = ((uint32_t) d[i] << 16) | ((uint32_t) d[i + 1] << 8)
+		  | d[i + 2];
+		out[out_len] = base64_chars[(v >> 18) & 0x3f];
+		out[out_len + 1] = base64_chars[(v >> 12) & 0x3f];
+		out[out_len + 2] = base64_chars[(v >> 6) & 0x3f];
+		out[out_len + 3] = base64_chars[v & 0x3f];
+		out_len += 4;
+		if (out_len >= sizeof(out)) {
+			write_bytes(w, out, out_len);
+			out_len = 0;
+		}
+	}
+	if (i < len) {
+		v = (uint32_t) d[i] << 16;
+		if (i + 1 < len) {
+			v |= (uint32_t) d[i + 1] << 8;
+		}
+		out[out_len] = base64_chars[(v >> 18) & 0x3f];
+		out[out_len + 1] = base64_chars[(v >> 12) & 0x3f];
+		out[out_len + 2] = i + 1 < len ?
+		    base64_chars[(v >> 6) & 0x3f] : '=';
+		out[out_len + 3] = '=';
+		out_len += 4;
+	}
+	write_bytes(w, out, out_len);
+	insert_char(w, '"');
+	end_value(w, 0);
+	end_of_prop(w);
+}
+
+// Write a property where the value is known to be a valid bare string,
+// so it can be copied without checking.
+static void write_bare_prop(struct yoctonw_writer *w, const char *name,
+                            const char *value, size_t value_len)
+{
+	if (w->error) {
+		return;
+	}
+	write_name(w, name, strlen(name));
+	write_bytes(w, value, value_len);
+	end_value(w, 1);
+	end_of_prop(w);
+}
+
+// Format an integer into the end of buf (which must be at least 20 bytes),
+// returning a pointer to the first digit. Two digits are converted at a
+// time using a lookup table.
+static char *format_uint(char *end, unsigned long long value)
+{
+	static const char digit_pairs[] =
+	    "00010203040506070809101112131415161718192021222324"
+	    "25262728293031323334353637383940414243444546474849"
+	    "50515253545556575859606162636465666768697071727374"
+	    "75767778798081828384858687888990919293949596979899";
+	char *p = end;
+	unsigned int i;
+
+	while (value >= 100) {
+		i = (unsigned int) (value % 100) * 2;
+		value /= 100;
+		p -= 2;
+		p[0] = digit_pairs[i];
+		p[1] = digit_pairs[i + 1];
+	}
+	if (value >= 10) {
+		i = (unsigned int) value * 2;
+		p -= 2;
+		p[0] = digit_pairs[i];
+		p[1] = digit_pairs[i + 1];
+	} else {
+		--p;
+		*p = (char) ('0' + value);
+	}
+	return p;
+}
+
+void yoctonw_int(struct yoctonw_writer *w, const char *name,
+                 signed long long value)
+{
+	char buf[24], *p;
+
+	// Negate as unsigned so that the most negative value works.
+	if (value < 0) {
+		p = format_uint(buf + sizeof(buf),
+		                0ULL - (unsigned long long) value);
+		--p;
+		*p = '-';
+	} else {
+		p = format_uint(buf + sizeof(buf), (unsigned long long) value);
+	}
+	write_bare_prop(w, name, p, buf + sizeof(buf) - p);
+}
+
+void yoctonw_uint(struct yoctonw_writer *w, const char *name,
+                  unsigned long long value)
+{
+	char buf[24], *p;
+
+	p = format_uint(buf + sizeof(buf), value);
+	write_bare_prop(w, name, p, buf + sizeof(buf) - p);
+}
+
+// Arbitrary precision unsigned integers, just big enough to format any
+// double exactly: the largest values used below are around 2^1080.
+#define BIGNUM_WORDS 40
+
+struct bignum {
+	uint32_t words[BIGNUM_WORDS];
+	int len;
+};
+
+static void bignum_set(struct bignum *b, uint64_t value)
+{
+	b->len = 0;
+	while (value != 0) {
+		b->words[b->len] = (uint32_t) value;
+		value >>= 32;
+		++b->len;
+	}
+}
+
+static void bignum_shift_left(struct bignum *b, int bits)
+{
+	int words = bits / 32, i;
+	uint32_t carry = 0;
+
+	bits %= 32;
+	if (b->len == 0) {
+		return;
+	}
+	if (bits != 0) {
+		for (i = 0; i < b->len; ++i) {
+			uint32_t w = b->words[i];
+			b->words[i] = (w << bits) | carry;
+			carry = w >> (32 - bits);
+		}
+		if (carry != 0) {
+			b->words[b->len] = carry;
+			++b->len;
+		}
+	}
+	if (words != 0) {
+		for (i = b->len - 1; i >= 0; --i) {
+			b->words[i + words] = b->words[i];
+		}
+		for (i = 0; i < words; ++i) {
+			b->words[i] = 0;
+		}
+		b->len += words;
+	}
+}
+
+static void bignum_mul(struct bignum *b, uint32_t m)
+{
+	uint64_t carry = 0;
+	int i;
+
+	for (i = 0; i < b->len; ++i) {
+		carry += (uint64_t) b->words[i] * m;
+		b->words[i] = (uint32_t) carry;
+		carry >>= 32;
+	}
+	if (carry != 0) {
+		b->words[b->len] = (uint32_t) carry;
+		++b->len;
+	}
+}
+
+static void bignum_mul_pow10(struct bignum *b, int n)
+{
+	static const uint32_t powers[] = {
+		1, 10, 100, 1000, 10000, 100000, 1000000, 10000000,
+		100000000, 1000000000,
+	};
+
+	for (; n >= 9; n -= 9) {
+		bignum_mul(b, powers[9]);
+	}
+	bignum_mul(b, powers[n]);
+}
+
+static int bignum_cmp(const struct bignum *a, const struct bignum *b)
+{
+	int i;
+
+	if (a->len != b->len) {
+		return a->len < b->len ? -1 : 1;
+	}
+	for (i = a->len - 1; i >= 0; --i) {
+		if (a->words[i] != b->words[i]) {
+			return a->words[i] < b->words[i] ? -1 : 1;
+		}
+	}
+	return 0;
+}
+
+static void bignum_add(struct bignum *result, const struct bignum *a,
+                       const struct bignum *b)
+{
+	uint64_t carry = 0;
+	int i;
+
+	if (a->len < b->len) {
+		const struct bignum *tmp = a;
+		a = b;
+		b = tmp;
+	}
+	for (i = 0; i < a->len; ++i) {
+		carry += a->words[i];
+		if (i < b->len) {
+			carry += b->words[i];
+		}
+		result->words[i] = (uint32_t) carry;
+		carry >>= 32;
+	}
+	result->len = a->len;
+	if (carry != 0) {
+		result->words[result->len] = (uint32_t) carry;
+		++result->len;
+	}
+}
+
+// Subtract b * m from a, where the result is known not to be negative.
+static void bignum_sub_mul(struct bignum *a, const struct bignum *b,
+                           uint32_t m)
+{
+	uint64_t product = 0, diff;
+	uint32_t borrow = 0;
+	int i;
+
+	for (i = 0; i < a->len; ++i) {
+		if (i < b->len) {
+			product += (uint64_t) b->words[i] * m;
+		}
+		diff = (uint64_t) a->words[i] - (uint32_t) product - borrow;
+		a->words[i] = (uint32_t) diff;
+		borrow = (uint32_t) (diff >> 32) & 1;
+		product >>= 32;
+	}
+	while (a->len > 0 && a->words[a->len - 1] == 0) {
+		--a->len;
+	}
+}
+
+// Find the shortest string of decimal digits that reads back as the
+// finite, positive value 'mantissa * 2^exponent', using the algorithm
+// from Burger & Dybvig, "Printing Floating-Point Numbers Quickly and
+// Accurately" (1996) with exact integer arithmetic. Digits are written to
+// 'digits' (at most 17) as values 0-9, the count is returned, and
+// '*point' is set so that the value is 0.<digits> * 10^*point.
+static int shortest_digits(uint64_t mantissa, int exponent, int unequal_gaps,
+                           uint8_t *digits, int *point)
+{
+	struct bignum r, s, m_plus, m_minus_buf, *m_minus = &m_plus, sum;
+	int even = (mantissa & 1) == 0, k, bits, low, high, c, n = 0;
+	uint64_t top;
+	uint32_t d;
+
+	// The value is r/s. Any value within m_minus/s below it or m_plus/s
+	// above it reads back as the same double, and round-half-even means
+	// the boundaries themselves are included when the mantissa is even.
+	bignum_set(&r, mantissa);
+	bignum_set(&s, 1);
+	bignum_set(&m_plus, 1);
+	if (unequal_gaps) {
+		// The gap below is half the gap above.
+		m_minus = &m_minus_buf;
+		bignum_set(m_minus, 1);
+		bignum_shift_left(&m_plus, 1);
+	}
+	if (exponent >= 0) {
+		bignum_shift_left(&r, exponent + 1 + unequal_gaps);
+		bignum_shift_left(&s, 1 + unequal_gaps);
+		bignum_shift_left(&m_plus, exponent);
+		if (m_minus != &m_plus) {
+			bignum_shift_left(m_minus, exponent);
+		}
+	} else {
+		bignum_shift_left(&r, 1 + unequal_gaps);
+		bignum_shift_left(&s, 1 - exponent + unequal_gaps);
+	}
+
+	// Estimate k = ceil(log10(value)) from the position of the top bit;
+	// 78913 / 2^18 is just below log10(2). The estimate can be too low,
+	// which is fixed below.
+	for (bits = 0; (mantissa >> bits) > 1; ++bits);
+	bits += exponent;
+	if (bits > 0) {
+		k = ((bits * 78913) >> 18) + 1;
+	} else {
+		k = -((-bits * 78913) >> 18);
+	}
+	if (k >= 0) {
+		bignum_mul_pow10(&s, k);
+	} else {
+		bignum_mul_pow10(&r, -k);
+		bignum_mul_pow10(&m_plus, -k);
+		if (m_minus != &m_plus) {
+			bignum_mul_pow10(m_minus, -k);
+		}
+	}
+	for (;;) {
+		bignum_add(&sum, &r, &m_plus);
+		c = bignum_cmp(&sum, &s);
+		if (even ? c < 0 : c <= 0) {
+			break;
+		}
+		bignum_mul(&s, 10);
+		++k;
+	}
+	*point = k;
+
+	// Shift everything so that the top word of s is large, so each digit
+	// can be estimated from the top words alone to within one.
+	for (bits = 0; (s.words[s.len - 1] << bits) < 0x10000000U; ++bits);
+	bignum_shift_left(&r, bits);
+	bignum_shift_left(&s, bits);
+	bignum_shift_left(&m_plus, bits);
+	if (m_minus != &m_plus) {
+		bignum_shift_left(m_minus, bits);
+	}
+
+	for (;;) {
+		bignum_mul(&r, 10);
+		bignum_mul(&m_plus, 10);
+		if (m_minus != &m_plus) {
+			bignum_mul(m_minus, 10);
+		}
+		top = r.len > s.len ? (uint64_t) r.words[s.len] << 32 : 0;
+		if (r.len >= s.len) {
+			top |= r.words[s.len - 1];
+		}
+		d = (uint32_t) (top / ((uint64_t) s.words[s.len - 1] + 1));
+		bignum_sub_mul(&r, &s, d);
+		if (bignum_cmp(&r, &s) >= 0) {
+			bignum_sub_mul(&r, &s, 1);
+			++d;
+		}
+		c = bignum_cmp(&r, m_minus);
+		low = even ? c <= 0 : c < 0;
+		bignum_add(&sum, &r, &m_plus);
+		c = bignum_cmp(&sum, &s);
+		high = even ? c >= 0 : c > 0;
+		if (low && high) {
+			// Either digit reads back correctly; pick the closer.
+			bignum_shift_left(&r, 1);
+			c = bignum_cmp(&r, &s);
+			if (c > 0 || (c == 0 && (d & 1) != 0)) {
+				++d;
+			}
+		} else if (high) {
+			++d;
+		}
+		digits[n] = (uint8_t) d;
+		++n;
+		if (low || high) {
+			return n;
+		}
+	}
+}
+
+// Format a double the way printf's "%.15g" would, but with the shortest
+// digits that read back as the same value (so up to 17 significant digits)
+// and without depending on the locale. buf must be at least 32 bytes.
+static size_t format_double(char *buf, double value)
+{
+	uint8_t digits[20];
+	uint64_t bits, mantissa;
+	int biased_exp, point, n, i, exp10;
+	size_t len = 0;
+	char tmp[24], *p;
+
+	memcpy(&bits, &value, sizeof(bits));
+	biased_exp = (int) ((bits >> 52) & 0x7ff);
+	mantissa = bits & ((1ULL << 52) - 1);
+	if (biased_exp == 0x7ff && mantissa != 0) {
+		memcpy(buf, "nan", 3);
+		return 3;
+	}
+	if ((bits >> 63) != 0) {
+		buf[0] = '-';
+		len = 1;
+		value = -value;
+	}
+	if (biased_exp == 0x7ff) {
+		memcpy(buf + len, "inf", 3);
+		return len + 3;
+	} else if (value == 0) {
+		buf[len] = '0';
+		return len + 1;
+	}
+	// Common case: integers that print without an exponent.
+	if (value < 1e15 && (double) (unsigned long long) value == value) {
+		p = format_uint(tmp + sizeof(tmp), (unsigned long long) value);
+		memcpy(buf + len, p, tmp + sizeof(tmp) - p);
+		return len + (tmp + sizeof(tmp) - p);
+	}
+
+	if (biased_exp == 0) {
+		n = shortest_digits(mantissa, -1074, 0, digits, &point);
+	} else {
+		n = shortest_digits(mantissa | (1ULL << 52), biased_exp - 1075,
+		                    mantissa == 0 && biased_exp > 1,
+		                    digits, &point);
+	}
+
+	// Like %g, use an exponent only for very large or small values.
+	exp10 = point - 1;
+	if (exp10 >= -4 && exp10 < (n > 15 ? n : 15)) {
+		if (point <= 0) {
+			buf[len] = '0';
+			buf[len + 1] = '.';
+			len += 2;
+			for (i = point; i < 0; ++i) {
+				buf[len] = '0';
+				++len;
+			}
+		}
+		for (i = 0; i < n || i < point; ++i) {
+			if (i == point && i > 0) {
+				buf[len] = '.';
+				++len;
+			}
+			buf[len] = (char) ('0' + (i < n ? digits[i] : 0));
+			++len;
+		}
+		return len;
+	}
+	for (i = 0; i < n; ++i) {
+		if (i == 1) {
+			buf[len] = '.';
+			++len;
+		}
+		buf[len] = (char) ('0' + digits[i]);
+		++len;
+	}
+	buf[len] = 'e';
+	buf[len + 1] = exp10 < 0 ? '-' : '+';
+	len += 2;
+	if (exp10 < 0) {
+		exp10 = -exp10;
+	}
+	if (exp10 < 10) {
+		buf[len] = '0';
+		++len;
+	}
+	p = format_uint(tmp + sizeof(tmp), (unsigned long long) exp10);
+	memcpy(buf + len, p, tmp + sizeof(tmp) - p);
+	return len + (tmp + sizeof(tmp) - p);
+}
+
+void yoctonw_double(struct yoctonw_writer *w, const char *name, double value)
+{
+	char buf[32];
+	size_t len;
+
+	len = format_double(buf, value);
+	write_bare_prop(w, name, buf, len);
+}
+
+void yoctonw_bool(struct yoctonw_writer *w, const char *name, int value)
+{
+	if (value) {
+		write_bare_prop(w, name, "true", 4);
+	} else {
+		write_bare_prop(w, name, "false", 5);
 	}
 }
 
 void yoctonw_subobject(struct yoctonw_writer *w, const char *name)
+{
+	yoctonw_subobject_n(w, name, strlen(name));
+}
+
+void yoctonw_subobject_n(struct yoctonw_writer *w, const char *name,
+                         size_t name_len)
 {
 	if (w->error) {
 		return;
 	}
-	write_indent(w);
-	write_string(w, name);
-	insert_char(w, ' ');
-	insert_char(w, '{');
-	insert_char(w, '\n');
+	if ((w->flags & YOCTONW_COMPACT) != 0) {
+		if (w->need_space) {
+			insert_char(w, ' ');
+		}
+		write_string(w, name, name_len);
+		insert_char(w, '{');
+		w->need_space = 0;
+	} else {
+		write_indent(w);
+		write_string(w, name, name_len);
+		write_bytes(w, " {\n", 3);
+	}
 	++w->indent_level;
+	end_of_prop(w);
 }
 
 void yoctonw_end(struct yoctonw_writer *w)
 {
-	if (w->indent_level == 0) {
+	if (w->indent_level <= w->base_indent_level) {
 		return;
 	}
 	--w->indent_level;
-	write_indent(w);
-	insert_char(w, '}');
-	insert_char(w, '\n');
-	if (w->indent_level == 0) {
-		yoctonw_flush(w);
+	if ((w->flags & YOCTONW_COMPACT) != 0) {
+		insert_char(w, '}');
+		w->need_space = 0;
+	} else {
+		write_indent(w);
+		write_bytes(w, "}\n", 2);
+	}
+	end_of_prop(w);
+}
+
+struct yoctonw_writer *yoctonw_child(struct yoctonw_writer *parent)
+{
+	struct yoctonw_writer *child = yoctonw_write_to_buffer();
+
+	if (child == NULL) {
+		return NULL;
+	}
+	child->flags = parent->flags;
+	child->indent_level = parent->indent_level;
+	child->base_indent_level = parent->indent_level;
+	// We don't know yet what will come before the child's output when it
+	// is spliced, so assume a space is needed. It is dropped when
+	// splicing if it turns out not to be.
+	child->need_space = 1;
+	return child;
+}
+
+void yoctonw_splice(struct yoctonw_writer *w, struct yoctonw_writer *child)
+{
+	const uint8_t *data = child->buf;
+	size_t len = child->buf_len;
+
+	if (child->error || child->indent_level != child->base_indent_level
+	 || child->base_indent_level != w->indent_level) {
+		w->error = 1;
+	}
+	if (w->error) {
+		yoctonw_free(child);
+		return;
+	}
+	if ((w->flags & YOCTONW_COMPACT) != 0 && len > 0) {
+		if (!w->need_space && data[0] == ' ') {
+			++data;
+			--len;
+		}
+		w->need_space = child->need_space;
+	}
+	write_value_bytes(w, data, len);
+	end_of_prop(w);
+	yoctonw_free(child);
+}
+
+struct yoctonw_writer *yoctonw_fragment_builder(void)
+{
+	struct yoctonw_writer *builder = yoctonw_write_to_buffer();
+
+	if (builder != NULL) {
+		// As with child writers, a leading space may be dropped later.
+		builder->need_space = 1;
+	}
+	return builder;
+}
+
+struct yoctonw_fragment *yoctonw_fragment_finish(struct yoctonw_writer *builder)
+{
+	struct yoctonw_fragment *f = NULL;
+
+	if (builder->indent_level != 0) {
+		goto fail;
+	}
+	f = (struct yoctonw_fragment *) calloc(1, sizeof(*f));
+	if (f == NULL) {
+		goto fail;
 	}
+	f->data = yoctonw_take_buffer(builder, &f->len);
+	if (f->data == NULL) {
+		goto fail;
+	}
+	f->compact = (builder->flags & YOCTONW_COMPACT) != 0;
+	f->need_space = builder->need_space;
+	yoctonw_free(builder);
+	return f;
+
+fail:
+	free(f);
+	yoctonw_free(builder);
+	return NULL;
+}
+
+void yoctonw_fragment_free(struct yoctonw_fragment *f)
+{
+	if (f != NULL) {
+		free(f->data);
+		free(f);
+	}
+}
+
+void yoctonw_raw_fragment(struct yoctonw_writer *w,
+                          const struct yoctonw_fragment *f)
+{
+	const uint8_t *data = (const uint8_t *) f->data;
+	const uint8_t *end = data + f->len, *eol;
+
+	if (w->error || f->len == 0) {
+		return;
+	}
+	if (f->compact && (w->flags & YOCTONW_COMPACT) == 0) {
+		// There is no line break or indentation to fit it in with
+		// the rest of the output.
+		w->error = 1;
+		return;
+	}
+	if (f->compact) {
+		if (!w->need_space && data[0] == ' ') {
+			++data;
+		}
+		write_value_bytes(w, data, end - data);
+		w->need_space = f->need_space;
+	} else if (w->indent_level == 0 || (w->flags & YOCTONW_COMPACT) != 0) {
+		if ((w->flags & YOCTONW_COMPACT) != 0 && w->need_space) {
+			insert_char(w, ' ');
+		}
+		write_value_bytes(w, data, f->len);
+		w->need_space = 0;
+	} else {
+		// Every line needs indenting to our current level.
+		while (data < end) {
+			eol = (const uint8_t *) memchr(data, '\n', end - data);
+			eol = eol != NULL ? eol + 1 : end;
+			write_indent(w);
+			write_value_bytes(w, data, eol - data);
+			data = eol;
+		}
+		w->need_space = 0;
+	}
+	end_of_prop(w);
+}
+
+// State for yoctonw_copy() while receiving input text.
+struct copy_state {
+	struct yoctonw_writer *w;
+	// Tabs to add to (or if negative, remove from) the start of each
+	// line, to adjust for a different nesting depth.
+	long shift;
+	int line_start;
+	size_t tabs_removed;
+	// Trailing whitespace is held back, since it may be the end of the
+	// value; there is no need to copy it.
+	uint8_t pending[64];
+	size_t pending_len;
+	// Last byte copied that was not whitespace.
+	uint8_t last;
+};
+
+static void copy_lines(struct copy_state *c, const uint8_t *data, size_t len)
+{
+	const uint8_t *end = data + len, *eol;
+
+	if (c->shift == 0) {
+		write_bytes(c->w, data, len);
+		return;
+	}
+	while (data < end) {
+		if (c->line_start && c->shift > 0) {
+			write_tabs(c->w, (size_t) c->shift);
+			c->line_start = 0;
+		}
+		while (c->line_start && data < end && *data == '\t'
+		    && c->tabs_removed < (size_t) -c->shift) {
+			++data;
+			++c->tabs_removed;
+		}
+		if (data >= end) {
+			break;
+		}
+		c->line_start = 0;
+		eol = (const uint8_t *) memchr(data, '\n', end - data);
+		eol = eol != NULL ? eol + 1 : end;
+		write_bytes(c->w, data, eol - data);
+		if (eol[-1] == '\n') {
+			c->line_start = 1;
+			c->tabs_removed = 0;
+		}
+		data = eol;
+	}
+}
+
+static int is_space(uint8_t c)
+{
+	return c == ' ' || c == '\n' || c == '\t' || c == '\r'
+	    || c == '\v' || c == '\f';
+}
+
+static void copy_raw(const void *data, size_t len, void *handle)
+{
+	struct copy_state *c = (struct copy_state *) handle;
+	const uint8_t *bytes = (const uint8_t *) data;
+	size_t n = len;
+
+	while (n > 0 && is_space(bytes[n - 1])) {
+		--n;
+	}
+	if (n > 0) {
+		copy_lines(c, c->pending, c->pending_len);
+		c->pending_len = 0;
+		copy_lines(c, bytes, n);
+		c->last = bytes[n - 1];
+	}
+	for (; n < len; ++n) {
+		if (c->pending_len >= sizeof(c->pending)) {
+			copy_lines(c, c->pending, c->pending_len);
+			c->pending_len = 0;
+		}
+		c->pending[c->pending_len] = bytes[n];
+		++c->pending_len;
+	}
+}
+
+void yoctonw_copy(struct yoctonw_writer *w, struct yocton_prop *p)
+{
+	struct copy_state c;
+	const char *name = yocton_prop_name(p);
+
+	if (w->error) {
+		return;
+	}
+	memset(&c, 0, sizeof(c));
+	c.w = w;
+	if ((w->flags & YOCTONW_COMPACT) == 0) {
+		c.shift = (long) w->indent_level
+		        - (long) __yocton_prop_depth(p);
+	}
+	if (yocton_prop_type(p) == YOCTON_PROP_OBJECT) {
+		if ((w->flags & YOCTONW_COMPACT) != 0) {
+			if (w->need_space) {
+				insert_char(w, ' ');
+			}
+			write_string(w, name, strlen(name));
+			insert_char(w, '{');
+		} else {
+			write_indent(w);
+			write_string(w, name, strlen(name));
+			write_bytes(w, " {", 2);
+		}
+		yocton_prop_raw(p, copy_raw, &c);
+		end_value(w, 0);
+	} else {
+		write_name(w, name, strlen(name));
+		yocton_prop_raw(p, copy_raw, &c);
+		// Quoted strings always end with a quote.
+		end_value(w, c.last != '"');
+	}
+	// A comment at the end of the value must be ended, even in compact
+	// mode.
+	if ((w->flags & YOCTONW_COMPACT) != 0
+	 && __yocton_prop_ends_in_comment(p)) {
+		insert_char(w, '\n');
+		w->need_space = 0;
+	}
+	// Output is incomplete if there was an error reading the input.
+	if (__yocton_prop_have_error(p)) {
+		w->error = 1;
+	}
+	end_of_prop(w);
 }
 
 int yoctonw_have_error(struct yoctonw_writer *w)
@@ -249,6 +1548,12 @@ void yoctonw_printf(struct yoctonw_writer *w, const char *name,
 	if (w->error) {
 		return;
 	}
+	// Ring writers must not allocate memory.
+	if (w->ring != NULL) {
+		w->record_dropped = 1;
+		end_of_prop(w);
+		return;
+	}
 	if (w->printf_buf_size == 0 && !increase_buffer(w, 128)) {
 		return;
 	}
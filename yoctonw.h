@@ -31,6 +31,10 @@ extern "C" {
  *
  * Functions for writing a Yocton file. The entrypoint is to use
  * @ref yoctonw_write_with or @ref yoctonw_write_to.
+ *
+ * Writers do not share any state with each other, so separate writers can
+ * be used concurrently from different threads. A single writer must only
+ * be used by one thread at a time.
  */
 
 /**
@@ -46,6 +50,29 @@ extern "C" {
  */
 typedef int (*yoctonw_write)(void *buf, size_t nbytes, void *handle);
 
+/** A piece of output passed to a @ref yoctonw_writev callback. */
+struct yoctonw_iovec {
+	/** Pointer to the data. */
+	const void *base;
+	/** Length of the data in bytes. */
+	size_t len;
+};
+
+/**
+ * Callback invoked to write more data to the output, as an array of
+ * pieces to be written one after another (scatter-gather output).
+ *
+ * @param iov     Array of pieces of output.
+ * @param iovcnt  Number of entries in the array.
+ * @param handle  Arbitrary pointer, passed through from
+ *                @ref yoctonw_writev_with.
+ * @return        1 for success; 0 for failure. If a failure status
+ *                is returned, the callback will not be invoked
+ *                again.
+ */
+typedef int (*yoctonw_writev)(const struct yoctonw_iovec *iov, int iovcnt,
+                              void *handle);
+
 struct yoctonw_writer;
 
 #ifdef __DOXYGEN__
@@ -77,6 +104,191 @@ typedef struct yoctonw_writer yoctonw_writer;
  */
 struct yoctonw_writer *yoctonw_write_with(yoctonw_write callback, void *handle);
 
+/**
+ * Start writing a new stream of yocton-encoded data, using a callback
+ * that takes an array of pieces of output, like the POSIX writev()
+ * function. Long names and values are not copied into the writer's
+ * buffer; instead the pieces passed to the callback point directly at
+ * the strings passed to @ref yoctonw_prop and similar functions. Each
+ * flush invokes the callback once.
+ *
+ * Since strings may be freed once the function they were passed to
+ * returns, output that refers to them is always flushed before that
+ * function returns, whatever the flush policy.
+ *
+ * Example that writes to a file descriptor:
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *   static int writev_callback(const struct yoctonw_iovec *iov,
+ *                              int iovcnt, void *handle) {
+ *       int fd = *(int *) handle;
+ *       ... call writev(fd, ...), handling short writes ...
+ *   }
+ *
+ *   w = yoctonw_writev_with(writev_callback, &fd);
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * @param callback  Callback function to invoke to write data.
+ * @param handle    Arbitrary pointer passed through when callback is
+ *                  invoked.
+ * @return          A @ref yoctonw_writer that can be used to output data.
+ */
+struct yoctonw_writer *yoctonw_writev_with(yoctonw_writev callback,
+                                           void *handle);
+
+/**
+ * Start writing yocton-encoded data into memory. The output is kept in a
+ * buffer that grows as needed, and can be retrieved with
+ * @ref yoctonw_take_buffer. Example:
+ *
+ * ~~~~~~~~~~~~~~~~~~~~
+ *   struct yoctonw_writer *w = yoctonw_write_to_buffer();
+ *   yoctonw_prop(w, "foo", "bar");
+ *   char *output = yoctonw_take_buffer(w, &len);
+ *   yoctonw_free(w);
+ * ~~~~~~~~~~~~~~~~~~~~
+ *
+ * The initial size of the buffer can be set with
+ * @ref yoctonw_set_buffer_size to avoid it being reallocated. The flush
+ * policy has no effect, and @ref yoctonw_flush does nothing.
+ *
+ * @return  A @ref yoctonw_writer that can be used to output data, or NULL
+ *          if there was a memory allocation failure.
+ */
+struct yoctonw_writer *yoctonw_write_to_buffer(void);
+
+/**
+ * Take the output written by a writer created with
+ * @ref yoctonw_write_to_buffer. The caller takes ownership of the buffer,
+ * and should free it with free(). The writer starts with an empty buffer
+ * again, so more output can be written and taken later.
+ *
+ * @param w    Writer.
+ * @param len  If not NULL, the length of the output in bytes is stored
+ *             here.
+ * @return     The output, which is NUL-terminated, or NULL if the writer
+ *             was not created with @ref yoctonw_write_to_buffer, or if
+ *             there was a memory allocation failure (see
+ *             @ref yoctonw_have_error).
+ */
+char *yoctonw_take_buffer(struct yoctonw_writer *w, size_t *len);
+
+/**
+ * Create a writer that does not write anything, but just counts how many
+ * bytes of output would be written. The same functions can then be used
+ * to measure the exact size of a document before writing it, for
+ * example to allocate a buffer of the right size. Example:
+ *
+ * ~~~~~~~~~~~~~~~~~~~~
+ *   struct yoctonw_writer *w = yoctonw_measure();
+ *   write_document(w);
+ *   size_t size = yoctonw_size(w);
+ *   yoctonw_free(w);
+ * ~~~~~~~~~~~~~~~~~~~~
+ *
+ * @return  A @ref yoctonw_writer, or NULL if there was a memory
+ *          allocation failure.
+ */
+struct yoctonw_writer *yoctonw_measure(void);
+
+/**
+ * Ring buffer that records are written into by a writer created with
+ * @ref yoctonw_write_to_ring, and read from by another thread with
+ * @ref yoctonw_ring_read. There can be one thread writing and one thread
+ * reading at the same time without any locking. The fields should not be
+ * accessed directly; the structure is only defined here so that it can be
+ * allocated statically.
+ */
+struct yoctonw_ring {
+	uint8_t *data;
+	size_t size;
+	size_t head, tail;
+	size_t dropped;
+};
+
+/**
+ * Initialize a ring buffer.
+ *
+ * @param ring  Ring buffer to initialize.
+ * @param data  Memory to use for the contents of the ring buffer.
+ * @param size  Size of the memory in bytes. This should be at least as
+ *              big as the largest record; records that do not fit are
+ *              dropped, so if it is zero, every record is dropped.
+ */
+void yoctonw_ring_init(struct yoctonw_ring *ring, void *data, size_t size);
+
+/**
+ * Start writing yocton-encoded records into a ring buffer, using only
+ * memory supplied by the caller. Each top-level property is a record,
+ * which is built up in the record buffer and then copied into the ring
+ * buffer in one go once it is complete, so the reader never sees part of
+ * a record. If a record does not fit in the record buffer, or there is
+ * not enough free space in the ring buffer, the record is dropped; see
+ * @ref yoctonw_ring_dropped.
+ *
+ * The writer never allocates memory, so it can be used from real-time
+ * code and signal handlers. The exception is @ref yoctonw_printf, which
+ * is not supported and drops the record. There is no need to call
+ * @ref yoctonw_free, since it does not free anything. Example:
+ *
+ * ~~~~~~~~~~~~~~~~~~~~
+ *   static uint8_t ring_data[64 * 1024], writer_mem[8192];
+ *   static struct yoctonw_ring ring;
+ *
+ *   yoctonw_ring_init(&ring, ring_data, sizeof(ring_data));
+ *   w = yoctonw_write_to_ring(&ring, writer_mem, sizeof(writer_mem));
+ *
+ *   // In a signal handler or real-time thread:
+ *   yoctonw_subobject(w, "event");
+ *   yoctonw_int(w, "signal", signum);
+ *   yoctonw_end(w);
+ *
+ *   // In another thread:
+ *   len = yoctonw_ring_read(&ring, buf, sizeof(buf));
+ *   fwrite(buf, 1, len, fs);
+ * ~~~~~~~~~~~~~~~~~~~~
+ *
+ * @param ring      Ring buffer to write records into.
+ * @param mem       Memory to hold the writer. The first part holds the
+ *                  writer's state, which needs a few kilobytes, and the
+ *                  rest is used as the record buffer.
+ * @param mem_size  Size of the memory in bytes.
+ * @return          A @ref yoctonw_writer that can be used to output data,
+ *                  or NULL if the memory is too small.
+ */
+struct yoctonw_writer *yoctonw_write_to_ring(struct yoctonw_ring *ring,
+                                             void *mem, size_t mem_size);
+
+/**
+ * Read complete records from a ring buffer.
+ *
+ * @param ring      Ring buffer.
+ * @param buf       Buffer to copy data into.
+ * @param buf_size  Size of buffer in bytes. If this is smaller than the
+ *                  data available, the rest is returned by the next call.
+ * @return          Number of bytes copied into the buffer, or zero if
+ *                  there is nothing to read.
+ */
+size_t yoctonw_ring_read(struct yoctonw_ring *ring, void *buf,
+                         size_t buf_size);
+
+/**
+ * Get the number of records that have been dropped from a ring buffer
+ * because they did not fit.
+ *
+ * @param ring  Ring buffer.
+ * @return      Number of records dropped.
+ */
+size_t yoctonw_ring_dropped(struct yoctonw_ring *ring);
+
+/**
+ * Get the total number of bytes of output written so far, including any
+ * output that has not been flushed yet.
+ *
+ * @param w  Writer.
+ * @return   Size of the output in bytes.
+ */
+size_t yoctonw_size(struct yoctonw_writer *w);
+
 /**
  * Start writing a new stream of yocton-encoded data, using the given
  * FILE handle. Example:
@@ -93,12 +305,174 @@ struct yoctonw_writer *yoctonw_write_with(yoctonw_write callback, void *handle);
 struct yoctonw_writer *yoctonw_write_to(FILE *fstream);
 
 /**
- * Free the writer and stop writing the output stream.
+ * Free the writer and stop writing the output stream. Any output that is
+ * still buffered is flushed first.
  *
  * @param w  The @ref yoctonw_writer.
  */
 void yoctonw_free(struct yoctonw_writer *w);
 
+/**
+ * Start writing a new output stream with an existing writer, instead of
+ * freeing it and creating a new one. The writer's buffers are kept, so
+ * writing many small documents does not need any memory to be allocated
+ * for each one. Any output that is still buffered is flushed to the old
+ * callback first, as with @ref yoctonw_free, and the error flag is
+ * cleared. The flags, flush policy and buffer size stay the same; the
+ * writer writes with a plain callback afterwards even if it was created
+ * with @ref yoctonw_writev_with (see @ref yoctonw_reset_writev).
+ *
+ * The reset fails, leaving the writer unchanged, if output cannot be
+ * flushed: if the output of a @ref yoctonw_write_to_buffer writer has not
+ * been taken with @ref yoctonw_take_buffer, or if a writer with the
+ * @ref YOCTONW_FLUSH_RECORD policy is in the middle of a record. If there
+ * has been an error, any such output is discarded instead, since it can
+ * never be written, and the writer is reset, but zero is still returned
+ * so that the error is not lost. Call @ref yoctonw_have_error before
+ * resetting to tell these cases apart.
+ *
+ * Example:
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *   for (;;) {
+ *       ... wait for request ...
+ *       if (!yoctonw_reset(w, send_response, conn)) {
+ *           ... previous response was not sent ...
+ *       }
+ *       yoctonw_prop(w, "status", "ok");
+ *       ...
+ *       yoctonw_flush(w);
+ *   }
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * @param w         The @ref yoctonw_writer. This must not be a writer
+ *                  created with @ref yoctonw_write_to_ring.
+ * @param callback  Callback function to invoke to write data, or NULL to
+ *                  write into memory, as with
+ *                  @ref yoctonw_write_to_buffer.
+ * @param handle    Arbitrary pointer passed through when callback is
+ *                  invoked.
+ * @return          1 for success, or 0 if the writer cannot be reset, if
+ *                  there is output that cannot be flushed, if there was
+ *                  a memory allocation failure, or if any output since
+ *                  the last reset could not be written.
+ */
+int yoctonw_reset(struct yoctonw_writer *w, yoctonw_write callback,
+                  void *handle);
+
+/**
+ * Start writing a new output stream with an existing writer, as with
+ * @ref yoctonw_reset, but write it with a writev-style callback, as with
+ * @ref yoctonw_writev_with.
+ *
+ * @param w         The @ref yoctonw_writer. This must not be a writer
+ *                  created with @ref yoctonw_write_to_ring.
+ * @param callback  Callback function to invoke to write data.
+ * @param handle    Arbitrary pointer passed through when callback is
+ *                  invoked.
+ * @return          As for @ref yoctonw_reset.
+ */
+int yoctonw_reset_writev(struct yoctonw_writer *w, yoctonw_writev callback,
+                         void *handle);
+
+/** Policies for when to flush output, set with @ref yoctonw_set_flush_policy. */
+enum yoctonw_flush_policy {
+	/**
+	 * Flush after every top-level property is completed. This is the
+	 * default, and means that output is always written promptly, but
+	 * can mean many small writes.
+	 */
+	YOCTONW_FLUSH_PROPERTY,
+
+	/**
+	 * Flush only when the output buffer is full, or when
+	 * @ref yoctonw_flush or @ref yoctonw_free is called. Output is
+	 * written in chunks the size of the buffer.
+	 */
+	YOCTONW_FLUSH_FULL,
+
+	/**
+	 * Flush after a top-level property is completed, once at least
+	 * the threshold number of bytes are waiting to be written, or when
+	 * the buffer is full.
+	 */
+	YOCTONW_FLUSH_THRESHOLD,
+
+	/**
+	 * Only flush when @ref yoctonw_flush or @ref yoctonw_free is called.
+	 * The output buffer grows as needed to hold all the output up until
+	 * then.
+	 */
+	YOCTONW_FLUSH_EXPLICIT,
+
+	/**
+	 * Flush after every top-level property is completed, and never in
+	 * the middle of one: the output buffer grows as needed to hold a
+	 * whole property, and @ref yoctonw_flush does nothing while a
+	 * subobject is open. Each call to the callback is one or more whole
+	 * top-level properties, so output from several writers can be
+	 * joined together without being interleaved; see
+	 * @ref yoctonw_mux_writer. In compact mode, each property starts
+	 * with a space, in case the output before it was a bare string.
+	 */
+	YOCTONW_FLUSH_RECORD,
+};
+
+/**
+ * Set when buffered output is written out by invoking the callback.
+ * When writing large documents to a file or pipe, @ref YOCTONW_FLUSH_FULL
+ * with a larger buffer (see @ref yoctonw_set_buffer_size) is much more
+ * efficient than the default.
+ *
+ * Example:
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *   w = yoctonw_write_to(fs);
+ *   yoctonw_set_flush_policy(w, YOCTONW_FLUSH_FULL, 0);
+ *   yoctonw_set_buffer_size(w, 64 * 1024);
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * @param w          Writer.
+ * @param policy     When to flush output.
+ * @param threshold  Number of bytes for @ref YOCTONW_FLUSH_THRESHOLD;
+ *                   ignored for the other policies.
+ */
+void yoctonw_set_flush_policy(struct yoctonw_writer *w,
+                              enum yoctonw_flush_policy policy,
+                              size_t threshold);
+
+/**
+ * Set the size of the output buffer. The default is 256 bytes.
+ *
+ * @param w     Writer.
+ * @param size  New size of the buffer in bytes.
+ * @return      Non-zero for success, or zero if size is zero or the
+ *              buffer could not be allocated. On failure the previous
+ *              buffer is still used.
+ */
+int yoctonw_set_buffer_size(struct yoctonw_writer *w, size_t size);
+
+/** Flags that can be set with @ref yoctonw_set_flags. */
+enum yoctonw_flags {
+	/**
+	 * Write compact output, without indentation or newlines, and with
+	 * only the spaces that are needed to separate properties. The
+	 * output can still be read by the parser. For example:
+	 * ~~~~~~~~~~~~~~~~~
+	 *   foo:bar baz:"qux quux"subobj{value:1}
+	 * ~~~~~~~~~~~~~~~~~
+	 */
+	YOCTONW_COMPACT = 0x01,
+};
+
+/**
+ * Set flags that change the output format. The flags should be set before
+ * anything is written.
+ *
+ * @param w      Writer.
+ * @param flags  Bitwise-OR of values from @ref yoctonw_flags, replacing
+ *               any flags that were previously set.
+ */
+void yoctonw_set_flags(struct yoctonw_writer *w, unsigned int flags);
+
 /**
  * Write a new property and value to the output.
  *
@@ -120,6 +494,34 @@ void yoctonw_free(struct yoctonw_writer *w);
 void yoctonw_prop(struct yoctonw_writer *w, const char *name,
                    const char *value);
 
+/**
+ * Write a new property and value to the output, where the name and value
+ * are given with explicit lengths rather than as NUL-terminated strings.
+ * This is useful when they are slices of a larger buffer.
+ *
+ * For example, the following code:
+ * ~~~~~~~~~~~~~~~~~
+ *   const char *s = "foobarbaz";
+ *   yoctonw_prop_n(w, s, 3, s + 3, 6);
+ * ~~~~~~~~~~~~~~~~~
+ * will produce the following output:
+ * ~~~~~~~~~~~~~~~~~
+ *   foo: barbaz
+ * ~~~~~~~~~~~~~~~~~
+ *
+ * The name and value must not contain any NUL bytes, since these cannot
+ * be represented in Yocton; if they do, the writer's error state is set
+ * (see @ref yoctonw_have_error).
+ *
+ * @param w          Writer.
+ * @param name       Property name.
+ * @param name_len   Length of name in bytes.
+ * @param value      Property value.
+ * @param value_len  Length of value in bytes.
+ */
+void yoctonw_prop_n(struct yoctonw_writer *w, const char *name,
+                    size_t name_len, const char *value, size_t value_len);
+
 /**
  * Write a new property with the value constructed printf-style.
  *
@@ -143,6 +545,86 @@ void yoctonw_prop(struct yoctonw_writer *w, const char *name,
 void yoctonw_printf(struct yoctonw_writer *w, const char *name,
                     const char *fmt, ...);
 
+/**
+ * Write a new property with a signed integer value. This is faster than
+ * using @ref yoctonw_printf.
+ *
+ * For example, `yoctonw_int(w, "temp", -35)` will produce:
+ * ~~~~~~~~~~~~~~~~~
+ *   temp: -35
+ * ~~~~~~~~~~~~~~~~~
+ *
+ * The value can be read back using @ref yocton_prop_int.
+ *
+ * @param w      Writer.
+ * @param name   Property name.
+ * @param value  Value to write.
+ */
+void yoctonw_int(struct yoctonw_writer *w, const char *name,
+                 signed long long value);
+
+/**
+ * Write a new property with an unsigned integer value. This is faster
+ * than using @ref yoctonw_printf.
+ *
+ * The value can be read back using @ref yocton_prop_uint.
+ *
+ * @param w      Writer.
+ * @param name   Property name.
+ * @param value  Value to write.
+ */
+void yoctonw_uint(struct yoctonw_writer *w, const char *name,
+                  unsigned long long value);
+
+/**
+ * Write a new property with a floating point value. The shortest
+ * representation (of up to 17 significant digits) that converts back to
+ * exactly the same value is used, and '.' is always used as the decimal
+ * point regardless of the current locale.
+ *
+ * For example, `yoctonw_double(w, "ratio", 0.1)` will produce:
+ * ~~~~~~~~~~~~~~~~~
+ *   ratio: 0.1
+ * ~~~~~~~~~~~~~~~~~
+ *
+ * @param w      Writer.
+ * @param name   Property name.
+ * @param value  Value to write.
+ */
+void yoctonw_double(struct yoctonw_writer *w, const char *name, double value);
+
+/**
+ * Write a new property with a boolean value, which is written as either
+ * `true` or `false`.
+ *
+ * @param w      Writer.
+ * @param name   Property name.
+ * @param value  Value to write; any nonzero value is true.
+ */
+void yoctonw_bool(struct yoctonw_writer *w, const char *name, int value);
+
+/**
+ * Write a new property with binary data as its value, encoded as base64.
+ *
+ * For example, the following code:
+ * ~~~~~~~~~~~~~~~~~
+ *   yoctonw_base64(w, "data", "hello world", 11);
+ * ~~~~~~~~~~~~~~~~~
+ * will produce the following output:
+ * ~~~~~~~~~~~~~~~~~
+ *   data: "aGVsbG8gd29ybGQ="
+ * ~~~~~~~~~~~~~~~~~
+ *
+ * The value can be decoded when reading using @ref yocton_prop_base64.
+ *
+ * @param w     Writer.
+ * @param name  Property name.
+ * @param data  Pointer to data to encode.
+ * @param len   Length of data in bytes.
+ */
+void yoctonw_base64(struct yoctonw_writer *w, const char *name,
+                    const void *data, size_t len);
+
 /**
  * Start writing a new subobject.
  *
@@ -166,6 +648,18 @@ void yoctonw_printf(struct yoctonw_writer *w, const char *name,
  */
 void yoctonw_subobject(struct yoctonw_writer *w, const char *name);
 
+/**
+ * Start writing a new subobject, where the name is given with an explicit
+ * length rather than as a NUL-terminated string. Otherwise the same as
+ * @ref yoctonw_subobject.
+ *
+ * @param w         Writer.
+ * @param name      Property name for subobject.
+ * @param name_len  Length of name in bytes.
+ */
+void yoctonw_subobject_n(struct yoctonw_writer *w, const char *name,
+                         size_t name_len);
+
 /**
  * End the current subobject.
  *
@@ -175,6 +669,144 @@ void yoctonw_subobject(struct yoctonw_writer *w, const char *name);
  */
 void yoctonw_end(struct yoctonw_writer *w);
 
+/**
+ * Create a child writer, which can be used to write part of the output
+ * separately, for example on another thread. Output written to the child
+ * is kept in memory, indented to the parent's current depth, until it is
+ * added to the parent's output with @ref yoctonw_splice. This allows
+ * independent parts of a large document to be written in parallel, and
+ * then spliced in order.
+ *
+ * The child does not share any state with the parent, so the child can
+ * be used on one thread while the parent or other children are used on
+ * others. The child is only for writing properties at the parent's
+ * current level: @ref yoctonw_end on the child cannot end the subobject
+ * that the parent is inside.
+ *
+ * Example:
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *   yoctonw_subobject(w, "big_section");
+ *   for (i = 0; i < num_threads; ++i) {
+ *       children[i] = yoctonw_child(w);
+ *       ... start thread to write part of the section to children[i] ...
+ *   }
+ *   for (i = 0; i < num_threads; ++i) {
+ *       ... wait for thread ...
+ *       yoctonw_splice(w, children[i]);
+ *   }
+ *   yoctonw_end(w);
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * @param w  Parent writer.
+ * @return   New writer, or NULL if there was a memory allocation failure.
+ */
+struct yoctonw_writer *yoctonw_child(struct yoctonw_writer *w);
+
+/**
+ * Add the output from a child writer created with @ref yoctonw_child to
+ * the output of its parent, and free the child. The parent must be at
+ * the same depth as when the child was created, and any subobjects
+ * started on the child must have been ended; if not, or if an error
+ * occurred on the child, the parent's error state is set (see
+ * @ref yoctonw_have_error).
+ *
+ * @param w      Parent writer.
+ * @param child  Child writer, which is freed.
+ */
+void yoctonw_splice(struct yoctonw_writer *w, struct yoctonw_writer *child);
+
+/**
+ * A block of output that has been written once and can then be added to
+ * the output of any number of writers with @ref yoctonw_raw_fragment.
+ * Fragments are not modified once created, so they can be shared between
+ * threads.
+ */
+struct yoctonw_fragment;
+
+/**
+ * Create a writer for building a @ref yoctonw_fragment. Use the normal
+ * functions to write to it, then @ref yoctonw_fragment_finish to get the
+ * fragment. Output is written without indentation, and indented when
+ * the fragment is used. The @ref YOCTONW_COMPACT flag can be set on the
+ * builder, in which case the fragment can only be used with compact
+ * writers.
+ *
+ * Example:
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *   struct yoctonw_writer *b = yoctonw_fragment_builder();
+ *   yoctonw_prop(b, "version", "1.0");
+ *   yoctonw_subobject(b, "defaults");
+ *   ...
+ *   yoctonw_end(b);
+ *   struct yoctonw_fragment *header = yoctonw_fragment_finish(b);
+ *
+ *   // Later, possibly many times:
+ *   yoctonw_raw_fragment(w, header);
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * @return  New writer, or NULL if there was a memory allocation failure.
+ */
+struct yoctonw_writer *yoctonw_fragment_builder(void);
+
+/**
+ * Finish building a fragment, freeing the builder.
+ *
+ * @param builder  Writer created with @ref yoctonw_fragment_builder.
+ * @return         New fragment, or NULL if a subobject written to the
+ *                 builder was not ended, or if an error occurred.
+ */
+struct yoctonw_fragment *yoctonw_fragment_finish(
+	struct yoctonw_writer *builder);
+
+/**
+ * Free a fragment.
+ *
+ * @param f  Fragment to free.
+ */
+void yoctonw_fragment_free(struct yoctonw_fragment *f);
+
+/**
+ * Add a fragment to the output. This is much faster than writing its
+ * contents again, since names and values do not need to be checked or
+ * escaped. If the writer is inside a subobject, each line of the fragment
+ * is indented to match. Adding a compact fragment to a writer without
+ * the @ref YOCTONW_COMPACT flag is an error.
+ *
+ * @param w  Writer.
+ * @param f  Fragment to write.
+ */
+void yoctonw_raw_fragment(struct yoctonw_writer *w,
+                          const struct yoctonw_fragment *f);
+
+struct yocton_prop;
+
+/**
+ * Copy a property being read by a Yocton parser to the output. The value
+ * is copied from the input text as it is, without decoding and escaping
+ * it again, which is much faster than reading the value and writing it
+ * out. For a subobject, everything inside it is copied, including any
+ * comments. Lines are indented again if the property is at a different
+ * nesting depth from the one in the input. The formatting of the input is
+ * kept, so in compact mode, the output is only compact if the input was.
+ *
+ * Example of a filter that removes properties named "debug":
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *   while ((p = yocton_next_prop(obj)) != NULL) {
+ *     if (strcmp(yocton_prop_name(p), "debug") != 0) {
+ *       yoctonw_copy(w, p);
+ *     }
+ *   }
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * @param w  Writer.
+ * @param p  Property to copy. The value of the property must not have
+ *           been read yet. The value of a string property, or the
+ *           properties of a subobject, cannot be read afterwards. If there
+ *           is an error parsing the input, the error flag is set on the
+ *           writer, since the output will be incomplete.
+ */
+void yoctonw_copy(struct yoctonw_writer *w, struct yocton_prop *p);
+
 /**
  * Check if an error occurred.
  *
@@ -186,9 +818,10 @@ int yoctonw_have_error(struct yoctonw_writer *w);
 /**
  * Flush output buffer and write all pending data.
  *
- * Note that data is automatically flushed whenever a new top-level property is
- * written, so the main use of this is to force any pending data to be written
- * while writing a subobject.
+ * Note that with the default flush policy, data is automatically flushed
+ * whenever a new top-level property is written, so the main use of this is
+ * to force any pending data to be written while writing a subobject. See
+ * @ref yoctonw_set_flush_policy.
  *
  * @param w  Writer.
  */
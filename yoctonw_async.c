@@ -0,0 +1,219 @@
+//
+// Copyright (c) 2022, Simon Howard
+//
+// Permission to use, copy, modify, and/or distribute this software
+// for any purpose with or without fee is hereby granted, provided
+// that the above copyright notice and this permission notice appear
+// in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+// WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+// AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+#include "yoctonw_async.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "yoctonw.h"
+
+#define DEFAULT_NUM_BUFFERS 3
+#define DEFAULT_BUFFER_SIZE (64 * 1024)
+
+struct async_buffer {
+	uint8_t *data;
+	size_t len;
+};
+
+struct yoctonw_async {
+	yoctonw_write callback;
+	void *callback_handle;
+	// Buffers are used in turn. buffers[head:head+count] (wrapping
+	// around) are waiting to be written by the background thread, and
+	// buffers[fill] after them is being filled by the writer. Everything
+	// except fill and the buffer being filled is protected by lock.
+	struct async_buffer *buffers;
+	unsigned int num_buffers, head, count, fill;
+	size_t buffer_size;
+	pthread_mutex_t lock;
+	// Signalled by the background thread when it has finished writing
+	// a buffer, and by the writer when there is a buffer to write.
+	pthread_cond_t written, pending;
+	pthread_t thread;
+	int error, stop;
+	// Copy of error, owned by the writer's thread.
+	int error_seen;
+};
+
+static void *write_thread(void *arg)
+{
+	struct yoctonw_async *a = (struct yoctonw_async *) arg;
+	struct async_buffer *b;
+	int ok;
+
+	pthread_mutex_lock(&a->lock);
+	for (;;) {
+		while (a->count == 0 && !a->stop) {
+			pthread_cond_wait(&a->pending, &a->lock);
+		}
+		if (a->count == 0) {
+			break;
+		}
+		b = &a->buffers[a->head];
+		// Once there has been an error, buffers are thrown away.
+		ok = !a->error;
+		pthread_mutex_unlock(&a->lock);
+		if (ok) {
+			ok = a->callback(b->data, b->len, a->callback_handle);
+		}
+		pthread_mutex_lock(&a->lock);
+		if (!ok) {
+			a->error = 1;
+		}
+		b->len = 0;
+		a->head = (a->head + 1) % a->num_buffers;
+		--a->count;
+		pthread_cond_broadcast(&a->written);
+	}
+	pthread_mutex_unlock(&a->lock);
+	return NULL;
+}
+
+static void free_async(struct yoctonw_async *a)
+{
+	unsigned int i;
+
+	for (i = 0; i < a->num_buffers; ++i) {
+		free(a->buffers[i].data);
+	}
+	free(a->buffers);
+	free(a);
+}
+
+struct yoctonw_async *yoctonw_async_new(yoctonw_write callback, void *handle,
+                                        unsigned int num_buffers,
+                                        size_t buffer_size)
+{
+	struct yoctonw_async *a;
+	unsigned int i;
+
+	a = (struct yoctonw_async *) calloc(1, sizeof(struct yoctonw_async));
+	if (a == NULL) {
+		return NULL;
+	}
+	a->callback = callback;
+	a->callback_handle = handle;
+	a->num_buffers = num_buffers != 0 ? num_buffers : DEFAULT_NUM_BUFFERS;
+	a->buffer_size = buffer_size != 0 ? buffer_size : DEFAULT_BUFFER_SIZE;
+	if (a->num_buffers < 2) {
+		free(a);
+		return NULL;
+	}
+	a->buffers = (struct async_buffer *) calloc(
+	    a->num_buffers, sizeof(struct async_buffer));
+	if (a->buffers == NULL) {
+		free(a);
+		return NULL;
+	}
+	for (i = 0; i < a->num_buffers; ++i) {
+		a->buffers[i].data = (uint8_t *) malloc(a->buffer_size);
+		if (a->buffers[i].data == NULL) {
+			free_async(a);
+			return NULL;
+		}
+	}
+	pthread_mutex_init(&a->lock, NULL);
+	pthread_cond_init(&a->written, NULL);
+	pthread_cond_init(&a->pending, NULL);
+	if (pthread_create(&a->thread, NULL, write_thread, a) != 0) {
+		pthread_cond_destroy(&a->pending);
+		pthread_cond_destroy(&a->written);
+		pthread_mutex_destroy(&a->lock);
+		free_async(a);
+		return NULL;
+	}
+	return a;
+}
+
+// Hand the buffer being filled to the background thread. We only wait if
+// there is no free buffer to fill next.
+static void hand_over(struct yoctonw_async *a)
+{
+	pthread_mutex_lock(&a->lock);
+	++a->count;
+	pthread_cond_signal(&a->pending);
+	while (a->count >= a->num_buffers) {
+		pthread_cond_wait(&a->written, &a->lock);
+	}
+	a->fill = (a->head + a->count) % a->num_buffers;
+	a->error_seen = a->error;
+	pthread_mutex_unlock(&a->lock);
+}
+
+int yoctonw_async_write(void *buf, size_t nbytes, void *handle)
+{
+	struct yoctonw_async *a = (struct yoctonw_async *) handle;
+	const uint8_t *data = (const uint8_t *) buf;
+	struct async_buffer *b;
+	size_t n;
+
+	while (nbytes > 0 && !a->error_seen) {
+		b = &a->buffers[a->fill];
+		n = a->buffer_size - b->len;
+		if (n > nbytes) {
+			n = nbytes;
+		}
+		memcpy(b->data + b->len, data, n);
+		b->len += n;
+		data += n;
+		nbytes -= n;
+		if (b->len == a->buffer_size) {
+			hand_over(a);
+		}
+	}
+	return !a->error_seen;
+}
+
+int yoctonw_async_flush(struct yoctonw_async *a)
+{
+	if (a->buffers[a->fill].len > 0) {
+		hand_over(a);
+	}
+	return !a->error_seen;
+}
+
+int yoctonw_async_finish(struct yoctonw_async *a)
+{
+	yoctonw_async_flush(a);
+	pthread_mutex_lock(&a->lock);
+	while (a->count > 0) {
+		pthread_cond_wait(&a->written, &a->lock);
+	}
+	a->error_seen = a->error;
+	pthread_mutex_unlock(&a->lock);
+	return !a->error_seen;
+}
+
+void yoctonw_async_free(struct yoctonw_async *a)
+{
+	if (a == NULL) {
+		return;
+	}
+	yoctonw_async_finish(a);
+	pthread_mutex_lock(&a->lock);
+	a->stop = 1;
+	pthread_cond_signal(&a->pending);
+	pthread_mutex_unlock(&a->lock);
+	pthread_join(a->thread, NULL);
+	pthread_cond_destroy(&a->pending);
+	pthread_cond_destroy(&a->written);
+	pthread_mutex_destroy(&a->lock);
+	free_async(a);
+}
@@ -0,0 +1,125 @@
+//
+// Copyright (c) 2022, Simon Howard
+//
+// Permission to use, copy, modify, and/or distribute this software
+// for any purpose with or without fee is hereby granted, provided
+// that the above copyright notice and this permission notice appear
+// in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+// WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+// AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+#ifndef YOCTONW_ASYNC_H
+#define YOCTONW_ASYNC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+
+#include "yoctonw.h"
+
+/**
+ * @file yoctonw_async.h
+ *
+ * Adapter for writing output from a background thread. Output from a
+ * writer is collected into one of a small number of buffers; once a
+ * buffer is full, it is handed to a background thread that passes it to
+ * the real output callback, while the writer carries on filling the next
+ * buffer. The thread that is writing the output therefore only waits for
+ * I/O if every buffer is waiting to be written.
+ */
+
+/**
+ * State for writing output in a background thread. The output of a writer
+ * goes through it by using @ref yoctonw_async_write as the writer's
+ * callback.
+ */
+struct yoctonw_async;
+
+/**
+ * Start a background thread for writing output. Example:
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *   struct yoctonw_async *a = yoctonw_async_new(
+ *       fwrite_callback, fs, 0, 0);
+ *   struct yoctonw_writer *w = yoctonw_write_with(yoctonw_async_write, a);
+ *   yoctonw_prop(w, "event", "started");
+ *   ...
+ *   yoctonw_free(w);
+ *   if (!yoctonw_async_finish(a)) {
+ *       // Handle error
+ *   }
+ *   yoctonw_async_free(a);
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * @param callback     Callback to invoke from the background thread to
+ *                     write data.
+ * @param handle       Arbitrary pointer passed through when callback is
+ *                     invoked.
+ * @param num_buffers  Number of buffers to use, which must be at least
+ *                     two; or zero to use three buffers (triple
+ *                     buffering).
+ * @param buffer_size  Size of each buffer in bytes, or zero for the
+ *                     default of 64 KiB.
+ * @return             New adapter, or NULL on failure.
+ */
+struct yoctonw_async *yoctonw_async_new(yoctonw_write callback, void *handle,
+                                        unsigned int num_buffers,
+                                        size_t buffer_size);
+
+/**
+ * Callback to pass to @ref yoctonw_write_with, to write the output of a
+ * writer from the background thread. The data is copied into the current
+ * buffer. Errors from the background thread are returned the next time a
+ * buffer is handed over to it, so a writer sees them as an error from a
+ * later flush.
+ *
+ * @param buf     Data to write.
+ * @param nbytes  Length of data in bytes.
+ * @param handle  Pointer to a @ref yoctonw_async.
+ * @return        1 for success, or 0 if an earlier write by the background
+ *                thread failed.
+ */
+int yoctonw_async_write(void *buf, size_t nbytes, void *handle);
+
+/**
+ * Hand over the current buffer to the background thread, even if it is
+ * not full yet, without waiting for it to be written. Call
+ * @ref yoctonw_flush on the writer first.
+ *
+ * @param a  Adapter.
+ * @return   1 for success, or 0 if an earlier write failed.
+ */
+int yoctonw_async_flush(struct yoctonw_async *a);
+
+/**
+ * Wait until all output has been written by the background thread. This
+ * should be called once the writer has been freed with @ref yoctonw_free.
+ *
+ * @param a  Adapter.
+ * @return   1 for success, or 0 if any write failed.
+ */
+int yoctonw_async_finish(struct yoctonw_async *a);
+
+/**
+ * Write any remaining output, stop the background thread and free the
+ * adapter.
+ *
+ * @param a  Adapter to free.
+ */
+void yoctonw_async_free(struct yoctonw_async *a);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef YOCTONW_ASYNC_H */
@@ -0,0 +1,177 @@
+//
+// Copyright (c) 2022, Simon Howard
+//
+// Permission to use, copy, modify, and/or distribute this software
+// for any purpose with or without fee is hereby granted, provided
+// that the above copyright notice and this permission notice appear
+// in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+// WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+// AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+#include "yoctonw_mux.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "yoctonw.h"
+
+struct yoctonw_mux {
+	yoctonw_write callback;
+	void *callback_handle;
+	// Output collected from all writers; buf[:buf_len] is still to be
+	// written. buf, buf_len and spare are protected by lock.
+	pthread_mutex_t lock;
+	uint8_t *buf, *spare;
+	size_t buf_len, buf_size;
+	// Set once a write has failed; also protected by lock.
+	int error;
+	// Held while invoking the callback, so that the lock is not held
+	// during I/O. It is only ever taken with lock held, so output is
+	// written in the order it was added. io_error is the same as error,
+	// but protected by io_lock, so that no more writes are attempted
+	// after one fails.
+	pthread_mutex_t io_lock;
+	int io_error;
+};
+
+struct yoctonw_mux *yoctonw_mux_new(yoctonw_write callback, void *handle,
+                                    size_t buffer_size)
+{
+	struct yoctonw_mux *mux;
+
+	mux = (struct yoctonw_mux *) calloc(1, sizeof(struct yoctonw_mux));
+	if (mux == NULL) {
+		return NULL;
+	}
+	if (buffer_size > 0) {
+		mux->buf = (uint8_t *) malloc(buffer_size);
+		mux->spare = (uint8_t *) malloc(buffer_size);
+		if (mux->buf == NULL || mux->spare == NULL) {
+			free(mux->buf);
+			free(mux->spare);
+			free(mux);
+			return NULL;
+		}
+	}
+	mux->callback = callback;
+	mux->callback_handle = handle;
+	mux->buf_size = buffer_size;
+	pthread_mutex_init(&mux->lock, NULL);
+	pthread_mutex_init(&mux->io_lock, NULL);
+	return mux;
+}
+
+// Invoke the callback; called with io_lock held.
+static void write_out(struct yoctonw_mux *mux, void *buf, size_t nbytes)
+{
+	if (nbytes > 0 && !mux->io_error
+	 && !mux->callback(buf, nbytes, mux->callback_handle)) {
+		mux->io_error = 1;
+	}
+}
+
+// Release io_lock after writing, and return 1 if no write has failed.
+static int finish_io(struct yoctonw_mux *mux)
+{
+	int io_error = mux->io_error, result;
+
+	pthread_mutex_unlock(&mux->io_lock);
+	pthread_mutex_lock(&mux->lock);
+	mux->error = mux->error || io_error;
+	result = !mux->error;
+	pthread_mutex_unlock(&mux->lock);
+	return result;
+}
+
+// Take io_lock and swap in the spare buffer, returning the length of the
+// output in what is now the spare buffer; called with lock held. Once the
+// lock is released the caller must write the spare buffer and release
+// io_lock. Waiting for io_lock here means that the previous contents of
+// the spare buffer have been written.
+static size_t swap_buffers_locked(struct yoctonw_mux *mux)
+{
+	uint8_t *full = mux->buf;
+	size_t full_len = mux->buf_len;
+
+	pthread_mutex_lock(&mux->io_lock);
+	mux->buf = mux->spare;
+	mux->spare = full;
+	mux->buf_len = 0;
+	return full_len;
+}
+
+// Callback for the writers, invoked with one or more whole records.
+static int mux_write(void *buf, size_t nbytes, void *handle)
+{
+	struct yoctonw_mux *mux = (struct yoctonw_mux *) handle;
+	size_t full_len;
+	int result;
+
+	pthread_mutex_lock(&mux->lock);
+	if (mux->buf_len + nbytes <= mux->buf_size) {
+		memcpy(mux->buf + mux->buf_len, buf, nbytes);
+		mux->buf_len += nbytes;
+		result = !mux->error;
+		pthread_mutex_unlock(&mux->lock);
+		return result;
+	}
+	full_len = swap_buffers_locked(mux);
+	if (nbytes <= mux->buf_size) {
+		memcpy(mux->buf, buf, nbytes);
+		mux->buf_len = nbytes;
+		nbytes = 0;
+	}
+	pthread_mutex_unlock(&mux->lock);
+
+	// Other writers can add to the buffer while this output is written.
+	write_out(mux, mux->spare, full_len);
+	// Too big for the buffer, so write it straight away.
+	write_out(mux, buf, nbytes);
+	return finish_io(mux);
+}
+
+struct yoctonw_writer *yoctonw_mux_writer(struct yoctonw_mux *mux)
+{
+	struct yoctonw_writer *w = yoctonw_write_with(mux_write, mux);
+
+	if (w != NULL) {
+		yoctonw_set_flush_policy(w, YOCTONW_FLUSH_RECORD, 0);
+	}
+	return w;
+}
+
+int yoctonw_mux_flush(struct yoctonw_mux *mux)
+{
+	size_t full_len;
+
+	pthread_mutex_lock(&mux->lock);
+	full_len = swap_buffers_locked(mux);
+	pthread_mutex_unlock(&mux->lock);
+	write_out(mux, mux->spare, full_len);
+	return finish_io(mux);
+}
+
+int yoctonw_mux_free(struct yoctonw_mux *mux)
+{
+	int result;
+
+	if (mux == NULL) {
+		return 1;
+	}
+	result = yoctonw_mux_flush(mux);
+	pthread_mutex_destroy(&mux->lock);
+	pthread_mutex_destroy(&mux->io_lock);
+	free(mux->buf);
+	free(mux->spare);
+	free(mux);
+	return result;
+}
@@ -0,0 +1,113 @@
+//
+// Copyright (c) 2022, Simon Howard
+//
+// Permission to use, copy, modify, and/or distribute this software
+// for any purpose with or without fee is hereby granted, provided
+// that the above copyright notice and this permission notice appear
+// in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+// WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+// AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+#ifndef YOCTONW_MUX_H
+#define YOCTONW_MUX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+
+#include "yoctonw.h"
+
+/**
+ * @file yoctonw_mux.h
+ *
+ * Support for writing to one output from several threads at once. Each
+ * thread has its own writer, created with @ref yoctonw_mux_writer, and
+ * whole top-level properties from each writer are added to the shared
+ * output in turn, so output from different threads is never mixed up.
+ */
+
+/**
+ * Shared output that several writers write to.
+ */
+struct yoctonw_mux;
+
+/**
+ * Create a new shared output.
+ *
+ * @param callback     Callback to invoke to write data. Only one thread
+ *                     invokes it at a time.
+ * @param handle       Arbitrary pointer passed through when callback is
+ *                     invoked.
+ * @param buffer_size  Size of the buffer that output from all writers is
+ *                     collected in before it is written, or zero to
+ *                     write each property as soon as it is complete.
+ *                     Two buffers of this size are allocated, so that
+ *                     writers can keep adding to one while the other is
+ *                     being written.
+ * @return             New shared output, or NULL on failure.
+ */
+struct yoctonw_mux *yoctonw_mux_new(yoctonw_write callback, void *handle,
+                                    size_t buffer_size);
+
+/**
+ * Create a writer that writes to a shared output. Each writer should only
+ * be used by one thread, but different threads can use different writers
+ * at the same time. Each top-level property is built up in the writer's
+ * own buffer, and then copied into the shared output's buffer using the
+ * @ref YOCTONW_FLUSH_RECORD flush policy. The callback is not invoked
+ * while that copy is made, so a slow output only holds up a writer when
+ * the buffer fills up again before the previous write has finished, or
+ * the property is too big for the buffer. Example:
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *   struct yoctonw_mux *mux = yoctonw_mux_new(fwrite_callback, fs, 0);
+ *
+ *   // In each thread:
+ *   struct yoctonw_writer *w = yoctonw_mux_writer(mux);
+ *   yoctonw_subobject(w, "event");
+ *   ...
+ *   yoctonw_end(w);
+ *   yoctonw_free(w);
+ *
+ *   // Once all threads are finished:
+ *   yoctonw_mux_free(mux);
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * @param mux  Shared output.
+ * @return     New writer, or NULL if there was a memory allocation
+ *             failure. The writer must be freed with @ref yoctonw_free
+ *             before the shared output is freed.
+ */
+struct yoctonw_writer *yoctonw_mux_writer(struct yoctonw_mux *mux);
+
+/**
+ * Write out any output collected in the shared output's buffer.
+ *
+ * @param mux  Shared output.
+ * @return     1 for success, or 0 if any write has failed.
+ */
+int yoctonw_mux_flush(struct yoctonw_mux *mux);
+
+/**
+ * Write out any remaining output and free a shared output.
+ *
+ * @param mux  Shared output to free.
+ * @return     1 for success, or 0 if any write failed.
+ */
+int yoctonw_mux_free(struct yoctonw_mux *mux);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef YOCTONW_MUX_H */
@@ -0,0 +1,1677 @@
+//
+// Copyright (c) 2022, Simon Howard
+//
+// Permission to use, copy, modify, and/or distribute this software
+// for any purpose with or without fee is hereby granted, provided
+// that the above copyright notice and this permission notice appear
+// in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+// WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+// AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+// Tests for the writer. Output is written into memory and then either
+// compared against the expected text, or read back with the parser to
+// check that it round-trips.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "yocton.h"
+#include "yoctonw.h"
+#include "yoctonw_async.h"
+#include "yoctonw_mux.h"
+
+struct output {
+	char *data;
+	size_t len, size;
+	// Number of calls to the write callback.
+	int writes;
+	// Largest number of pieces passed to a writev callback.
+	int max_iovcnt;
+};
+
+struct input {
+	const char *data;
+	size_t len, offset;
+};
+
+static int write_to_output(void *buf, size_t nbytes, void *handle)
+{
+	struct output *out = (struct output *) handle;
+
+	if (out->len + nbytes + 1 > out->size) {
+		while (out->len + nbytes + 1 > out->size) {
+			out->size = out->size == 0 ? 256 : out->size * 2;
+		}
+		out->data = (char *) realloc(out->data, out->size);
+		assert(out->data != NULL);
+	}
+	memcpy(out->data + out->len, buf, nbytes);
+	out->len += nbytes;
+	out->data[out->len] = '\0';
+	++out->writes;
+	return 1;
+}
+
+static int writev_to_output(const struct yoctonw_iovec *iov, int iovcnt,
+                            void *handle)
+{
+	struct output *out = (struct output *) handle;
+	int i;
+
+	if (iovcnt > out->max_iovcnt) {
+		out->max_iovcnt = iovcnt;
+	}
+	for (i = 0; i < iovcnt; ++i) {
+		write_to_output((void *) iov[i].base, iov[i].len, handle);
+	}
+	return 1;
+}
+
+static int fail_write(void *buf, size_t nbytes, void *handle)
+{
+	return 0;
+}
+
+static size_t read_from_input(void *buf, size_t buf_size, void *handle)
+{
+	struct input *in = (struct input *) handle;
+	size_t n = in->len - in->offset;
+
+	if (n > buf_size) {
+		n = buf_size;
+	}
+	memcpy(buf, in->data + in->offset, n);
+	in->offset += n;
+	return n;
+}
+
+static struct yoctonw_writer *new_writer(struct output *out)
+{
+	struct yoctonw_writer *w;
+
+	memset(out, 0, sizeof(*out));
+	w = yoctonw_write_with(write_to_output, out);
+	assert(w != NULL);
+	return w;
+}
+
+static struct yocton_object *read_output(struct input *in,
+                                         struct output *out)
+{
+	struct yocton_object *obj;
+
+	in->data = out->data;
+	in->len = out->len;
+	in->offset = 0;
+	obj = yocton_read_with(read_from_input, in);
+	assert(obj != NULL);
+	return obj;
+}
+
+static int check_output(const char *test_name, struct output *out,
+                        const char *expected)
+{
+	if (out->data == NULL || strcmp(out->data, expected) != 0) {
+		fprintf(stderr, "%s: wrong output, want:\n%s\ngot:\n%s\n",
+		        test_name, expected,
+		        out->data != NULL ? out->data : "");
+		return 0;
+	}
+	return 1;
+}
+
+static int check_parse_error(const char *test_name,
+                             struct yocton_object *obj)
+{
+	const char *error_msg;
+	int lineno;
+
+	if (yocton_have_error(obj, &lineno, &error_msg)) {
+		fprintf(stderr, "%s: error reading output, line %d: %s\n",
+		        test_name, lineno, error_msg);
+		return 0;
+	}
+	return 1;
+}
+
+static int test_basic(void)
+{
+	struct yoctonw_writer *w;
+	struct output out;
+	int success;
+
+	w = new_writer(&out);
+	yoctonw_prop(w, "name", "value");
+	yoctonw_prop(w, "quoted name", "");
+	yoctonw_subobject(w, "obj");
+	yoctonw_prop(w, "x", "1");
+	yoctonw_subobject(w, "inner");
+	yoctonw_printf(w, "y", "%d", 2);
+	yoctonw_end(w);
+	yoctonw_end(w);
+	yoctonw_base64(w, "data", "hello", 5);
+	success = check_output("test_basic", &out,
+		"name: value\n"
+		"\"quoted name\": \"\"\n"
+		"obj {\n"
+		"\tx: 1\n"
+		"\tinner {\n"
+		"\t\ty: 2\n"
+		"\t}\n"
+		"}\n"
+		"data: \"aGVsbG8=\"\n");
+	yoctonw_free(w);
+	free(out.data);
+	return success;
+}
+
+static int test_lengths(void)
+{
+	static const char buf[] = "foobar baz\"qux";
+	struct yoctonw_writer *w;
+	struct output out;
+	int success;
+
+	w = new_writer(&out);
+	yoctonw_prop_n(w, buf, 3, buf + 3, 3);
+	yoctonw_prop_n(w, buf, 6, buf + 3, 7);
+	yoctonw_prop_n(w, buf + 6, 4, buf + 10, 4);
+	yoctonw_prop_n(w, buf, 0, buf, 0);
+	yoctonw_subobject_n(w, buf + 7, 3);
+	yoctonw_end(w);
+	success = check_output("test_lengths", &out,
+		"foo: bar\n"
+		"foobar: \"bar baz\"\n"
+		"\" baz\": \"\\\"qux\"\n"
+		"\"\": \"\"\n"
+		"baz {\n"
+		"}\n");
+	if (yoctonw_have_error(w)) {
+		fprintf(stderr, "test_lengths: unexpected error\n");
+		success = 0;
+	}
+
+	// NUL bytes cannot be written.
+	yoctonw_prop_n(w, "nul", 3, "a\0b", 3);
+	if (!yoctonw_have_error(w)) {
+		fprintf(stderr, "test_lengths: no error writing NUL\n");
+		success = 0;
+	}
+	yoctonw_free(w);
+	free(out.data);
+	return success;
+}
+
+// Returns 3 - 2**n, computed without signed overflow for n == 63.
+static int64_t neg_power_of_two(int n)
+{
+	return (int64_t) (3 - (UINT64_C(1) << n));
+}
+
+static int test_numbers(void)
+{
+	static const double doubles[] = {
+		0.1, 1.0 / 3, 1e300, -2.5e-300, 123456789.0, 0.30000000000000004,
+		5e-324, 2.2250738585072014e-308, 1.7976931348623157e308,
+		9007199254740993.0, 1e15, 123456789012345678.0, -0.0,
+	};
+	struct yoctonw_writer *w;
+	struct yocton_object *obj;
+	struct yocton_prop *p;
+	struct output out;
+	struct input in;
+	size_t i;
+	int success;
+
+	w = new_writer(&out);
+	yoctonw_int(w, "int", 0);
+	yoctonw_int(w, "int", -35);
+	yoctonw_int(w, "int", INT64_MIN);
+	yoctonw_uint(w, "uint", 7);
+	yoctonw_uint(w, "uint", UINT64_MAX);
+	yoctonw_double(w, "double", 0.1);
+	yoctonw_double(w, "double", -1.5e-10);
+	yoctonw_double(w, "double", 5e-324);
+	yoctonw_double(w, "double", 1e23);
+	yoctonw_double(w, "double", 0.0001);
+	yoctonw_double(w, "double", 1e-5);
+	yoctonw_double(w, "double", 1e15 - 1);
+	yoctonw_double(w, "double", 0.1 + 0.2);
+	yoctonw_double(w, "double", -0.0);
+	yoctonw_bool(w, "bool", 1);
+	yoctonw_bool(w, "bool", 0);
+	success = check_output("test_numbers", &out,
+		"int: 0\n"
+		"int: -35\n"
+		"int: -9223372036854775808\n"
+		"uint: 7\n"
+		"uint: 18446744073709551615\n"
+		"double: 0.1\n"
+		"double: -1.5e-10\n"
+		"double: 5e-324\n"
+		"double: 1e+23\n"
+		"double: 0.0001\n"
+		"double: 1e-05\n"
+		"double: 999999999999999\n"
+		"double: 0.30000000000000004\n"
+		"double: -0\n"
+		"bool: true\n"
+		"bool: false\n");
+	yoctonw_free(w);
+	free(out.data);
+
+	// Check values read back exactly.
+	w = new_writer(&out);
+	for (i = 0; i < 64; ++i) {
+		yoctonw_int(w, "int", neg_power_of_two(i));
+		yoctonw_uint(w, "uint", (1ULL << i) * 3);
+	}
+	for (i = 0; i < sizeof(doubles) / sizeof(*doubles); ++i) {
+		yoctonw_double(w, "double", doubles[i]);
+	}
+	yoctonw_free(w);
+
+	obj = read_output(&in, &out);
+	for (i = 0; i < 128; ++i) {
+		p = yocton_next_prop(obj);
+		if (p == NULL) {
+			break;
+		} else if (i % 2 == 0 ? yocton_prop_int(p, 8)
+		                        != neg_power_of_two(i / 2)
+		                      : yocton_prop_uint(p, 8)
+		                        != (1ULL << (i / 2)) * 3) {
+			fprintf(stderr, "test_numbers: wrong value '%s'\n",
+			        yocton_prop_value(p));
+			success = 0;
+		}
+	}
+	for (i = 0; (p = yocton_next_prop(obj)) != NULL; ++i) {
+		if (strtod(yocton_prop_value(p), NULL) != doubles[i]) {
+			fprintf(stderr, "test_numbers: wrong value '%s'\n",
+			        yocton_prop_value(p));
+			success = 0;
+		}
+	}
+	success = check_parse_error("test_numbers", obj) && success;
+	yocton_free(obj);
+	free(out.data);
+	return success;
+}
+
+static int test_escapes(void)
+{
+	struct yoctonw_writer *w;
+	struct output out;
+	int success;
+
+	w = new_writer(&out);
+	yoctonw_prop(w, "escapes", "\"quote\" \\ new\nline\ttab\x01\x1f");
+	yoctonw_prop(w, "utf8", "caf\xc3\xa9");
+	success = check_output("test_escapes", &out,
+		"escapes: \"\\\"quote\\\" \\\\ new\\nline\\ttab\\x01\\x1f\"\n"
+		"utf8: \"caf\xc3\xa9\"\n");
+	yoctonw_free(w);
+	free(out.data);
+	return success;
+}
+
+// Strings with characters needing escapes at many different offsets,
+// long enough to span several flushes of the output buffer.
+static int test_long_strings(void)
+{
+	static const char specials[] = "\"\\\n\t\x01\xc3";
+	struct yoctonw_writer *w;
+	struct yocton_object *obj;
+	struct yocton_prop *p;
+	struct output out;
+	struct input in;
+	char value[1000];
+	int i, j, success = 1;
+
+	w = new_writer(&out);
+	for (i = 0; i < 300; ++i) {
+		for (j = 0; j < i; ++j) {
+			value[j] = 'a' + (j % 26);
+		}
+		value[i] = specials[i % (sizeof(specials) - 1)];
+		memset(value + i + 1, 'z', 500);
+		value[i + 501] = '\0';
+		yoctonw_prop(w, "value", value);
+	}
+	yoctonw_free(w);
+
+	obj = read_output(&in, &out);
+	for (i = 0; (p = yocton_next_prop(obj)) != NULL; ++i) {
+		for (j = 0; j < i; ++j) {
+			value[j] = 'a' + (j % 26);
+		}
+		value[i] = specials[i % (sizeof(specials) - 1)];
+		memset(value + i + 1, 'z', 500);
+		value[i + 501] = '\0';
+		if (strcmp(yocton_prop_value(p), value) != 0) {
+			fprintf(stderr, "test_long_strings: wrong value for "
+			        "string %d\n", i);
+			success = 0;
+		}
+	}
+	success = check_parse_error("test_long_strings", obj) && success;
+	if (i != 300) {
+		fprintf(stderr, "test_long_strings: read %d strings\n", i);
+		success = 0;
+	}
+	yocton_free(obj);
+	free(out.data);
+	return success;
+}
+
+static int test_deep_nesting(void)
+{
+	struct yoctonw_writer *w;
+	struct yocton_object *root, *obj;
+	struct yocton_prop *p;
+	struct output out;
+	struct input in;
+	int i, depth = 0, success;
+
+	w = new_writer(&out);
+	for (i = 0; i < 40; ++i) {
+		yoctonw_subobject(w, "obj");
+	}
+	yoctonw_prop(w, "deepest", "value");
+	for (i = 0; i < 40; ++i) {
+		yoctonw_end(w);
+	}
+	yoctonw_free(w);
+
+	root = obj = read_output(&in, &out);
+	while ((p = yocton_next_prop(obj)) != NULL
+	    && yocton_prop_type(p) == YOCTON_PROP_OBJECT) {
+		obj = yocton_prop_inner(p);
+		++depth;
+	}
+	success = check_parse_error("test_deep_nesting", obj);
+	if (depth != 40 || p == NULL
+	 || strcmp(yocton_prop_value(p), "value") != 0) {
+		fprintf(stderr, "test_deep_nesting: wrong result, depth=%d\n",
+		        depth);
+		success = 0;
+	}
+	// Check indentation of the deepest property.
+	if (strstr(out.data, "\n\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t"
+	                     "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t"
+	                     "deepest: value\n") == NULL) {
+		fprintf(stderr, "test_deep_nesting: wrong indentation\n");
+		success = 0;
+	}
+	yocton_free(root);
+	free(out.data);
+	return success;
+}
+
+static int test_base64(void)
+{
+	struct yoctonw_writer *w;
+	struct yocton_object *obj;
+	struct yocton_prop *p;
+	struct output out;
+	struct input in;
+	uint8_t data[200];
+	uint8_t *result;
+	size_t i, len;
+	int success = 1;
+
+	for (i = 0; i < sizeof(data); ++i) {
+		data[i] = (uint8_t) (i * 37);
+	}
+	w = new_writer(&out);
+	for (i = 0; i < sizeof(data); ++i) {
+		yoctonw_base64(w, "data", data, i);
+	}
+	yoctonw_free(w);
+
+	obj = read_output(&in, &out);
+	for (i = 0; (p = yocton_next_prop(obj)) != NULL; ++i) {
+		result = (uint8_t *) yocton_prop_base64(p, &len);
+		if (len != i || (len > 0 && memcmp(result, data, len) != 0)) {
+			fprintf(stderr, "test_base64: wrong data for length "
+			        "%d\n", (int) i);
+			success = 0;
+		}
+		free(result);
+	}
+	success = check_parse_error("test_base64", obj) && success;
+	yocton_free(obj);
+	free(out.data);
+	return success;
+}
+
+// Write the same document with each flush policy, checking the number of
+// times the callback is invoked.
+static int test_flush_policy(void)
+{
+	static const struct {
+		enum yoctonw_flush_policy policy;
+		size_t threshold;
+		int writes_before_free, writes;
+	} policies[] = {
+		{YOCTONW_FLUSH_PROPERTY, 0, 101, 101},
+		{YOCTONW_FLUSH_FULL, 0, 1, 2},
+		{YOCTONW_FLUSH_THRESHOLD, 200, 7, 8},
+		{YOCTONW_FLUSH_EXPLICIT, 0, 0, 1},
+	};
+	struct yoctonw_writer *w;
+	struct output out, expected = {NULL};
+	int i, j, success = 1;
+
+	for (i = -1; i < 4; ++i) {
+		w = new_writer(&out);
+		if (i >= 0) {
+			yoctonw_set_flush_policy(w, policies[i].policy,
+			                         policies[i].threshold);
+		}
+		if (!yoctonw_set_buffer_size(w, 1000)) {
+			fprintf(stderr, "test_flush_policy: failed to set "
+			        "buffer size\n");
+			success = 0;
+		}
+		for (j = 0; j < 100; ++j) {
+			yoctonw_int(w, "value", j * 1000000);
+		}
+		yoctonw_subobject(w, "obj");
+		yoctonw_prop(w, "a", "b");
+		yoctonw_end(w);
+		if (i >= 0 && out.writes != policies[i].writes_before_free) {
+			fprintf(stderr, "test_flush_policy: policy %d: %d "
+			        "writes before free, want %d\n", i,
+			        out.writes, policies[i].writes_before_free);
+			success = 0;
+		}
+		yoctonw_free(w);
+
+		if (i < 0) {
+			expected = out;
+			continue;
+		}
+		if (out.writes != policies[i].writes) {
+			fprintf(stderr, "test_flush_policy: policy %d: %d "
+			        "writes, want %d\n", i, out.writes,
+			        policies[i].writes);
+			success = 0;
+		}
+		success = check_output("test_flush_policy", &out,
+		                       expected.data) && success;
+		free(out.data);
+	}
+	free(expected.data);
+	return success;
+}
+
+// Writes a document containing long strings, to a writev callback and a
+// normal callback, then checks the output is the same. The strings are
+// overwritten after each call, which would show up any references held
+// past the end of the call.
+static void write_long_values(struct yoctonw_writer *w)
+{
+	char value[3000];
+	int i;
+
+	for (i = 0; i < 100; ++i) {
+		memset(value, 'a' + (i % 26), sizeof(value));
+		if (i % 3 == 0) {
+			value[(i * 31) % 2000] = '"';
+		}
+		value[(i * 97) % sizeof(value)] = '\0';
+		value[sizeof(value) - 1] = '\0';
+		if (i % 10 == 0) {
+			yoctonw_subobject(w, value);
+		} else {
+			yoctonw_prop(w, i % 2 ? "value" : value, value);
+		}
+		memset(value, '!', sizeof(value));
+		if (i % 10 == 9) {
+			yoctonw_end(w);
+		}
+	}
+}
+
+static int test_writev(void)
+{
+	struct yoctonw_writer *w;
+	struct output out, expected;
+	int success;
+
+	w = new_writer(&expected);
+	write_long_values(w);
+	yoctonw_free(w);
+
+	memset(&out, 0, sizeof(out));
+	w = yoctonw_writev_with(writev_to_output, &out);
+	assert(w != NULL);
+	write_long_values(w);
+	success = yoctonw_size(w) == expected.len;
+	yoctonw_free(w);
+
+	success = check_output("test_writev", &out, expected.data) && success;
+	// Long values should have been passed to the callback in place.
+	if (out.max_iovcnt < 3) {
+		fprintf(stderr, "test_writev: values not referenced\n");
+		success = 0;
+	}
+	free(out.data);
+	free(expected.data);
+	return success;
+}
+
+static int test_write_to_buffer(void)
+{
+	struct yoctonw_writer *w;
+	struct output expected;
+	char *result;
+	size_t len;
+	int success = 1;
+
+	w = new_writer(&expected);
+	write_long_values(w);
+	yoctonw_free(w);
+
+	w = yoctonw_write_to_buffer();
+	assert(w != NULL);
+	write_long_values(w);
+	yoctonw_flush(w);
+	result = yoctonw_take_buffer(w, &len);
+	if (result == NULL || len != expected.len
+	 || strcmp(result, expected.data) != 0) {
+		fprintf(stderr, "test_write_to_buffer: wrong output\n");
+		success = 0;
+	}
+	free(result);
+
+	// Writer can be reused after taking the buffer.
+	yoctonw_prop(w, "foo", "bar");
+	result = yoctonw_take_buffer(w, &len);
+	if (result == NULL || strcmp(result, "foo: bar\n") != 0 || len != 9) {
+		fprintf(stderr, "test_write_to_buffer: wrong output after "
+		        "reuse\n");
+		success = 0;
+	}
+	free(result);
+
+	result = yoctonw_take_buffer(w, &len);
+	if (result == NULL || len != 0 || strcmp(result, "") != 0) {
+		fprintf(stderr, "test_write_to_buffer: expected empty "
+		        "output\n");
+		success = 0;
+	}
+	free(result);
+	yoctonw_free(w);
+	free(expected.data);
+	return success;
+}
+
+static void write_mixed_document(struct yoctonw_writer *w)
+{
+	write_long_values(w);
+	yoctonw_subobject(w, "numbers");
+	yoctonw_int(w, "int", -12345);
+	yoctonw_uint(w, "uint", 12345);
+	yoctonw_double(w, "double", 1.0 / 3);
+	yoctonw_bool(w, "bool", 1);
+	yoctonw_printf(w, "printf", "%s %d", "formatted", 42);
+	yoctonw_end(w);
+	yoctonw_base64(w, "data", "some data\n", 10);
+	yoctonw_prop(w, "escapes", "\x01\"\t\\");
+}
+
+static int test_measure(void)
+{
+	struct yoctonw_writer *w;
+	struct output out;
+	size_t size;
+	int success = 1;
+
+	w = yoctonw_measure();
+	assert(w != NULL);
+	write_mixed_document(w);
+	size = yoctonw_size(w);
+	yoctonw_free(w);
+
+	w = new_writer(&out);
+	write_mixed_document(w);
+	if (yoctonw_size(w) != out.len) {
+		fprintf(stderr, "test_measure: yoctonw_size() returned %d, "
+		        "output was %d bytes\n", (int) yoctonw_size(w),
+		        (int) out.len);
+		success = 0;
+	}
+	yoctonw_free(w);
+
+	if (size != out.len) {
+		fprintf(stderr, "test_measure: measured %d bytes, output "
+		        "was %d bytes\n", (int) size, (int) out.len);
+		success = 0;
+	}
+	free(out.data);
+	return success;
+}
+
+// Summarize everything read from the given object as a string.
+static void digest_obj(struct output *d, struct yocton_object *obj)
+{
+	struct yocton_prop *p;
+	const char *s;
+
+	while ((p = yocton_next_prop(obj)) != NULL) {
+		s = yocton_prop_name(p);
+		write_to_output((void *) s, strlen(s), d);
+		if (yocton_prop_type(p) == YOCTON_PROP_OBJECT) {
+			write_to_output("{", 1, d);
+			digest_obj(d, yocton_prop_inner(p));
+			write_to_output("}", 1, d);
+		} else {
+			s = yocton_prop_value(p);
+			write_to_output(":", 1, d);
+			write_to_output((void *) s, strlen(s), d);
+			write_to_output("\n", 1, d);
+		}
+	}
+}
+
+static int test_compact(void)
+{
+	struct yoctonw_writer *w;
+	struct yocton_object *obj;
+	struct output out, compact, digest1, digest2;
+	struct input in;
+	int success;
+
+	w = new_writer(&out);
+	yoctonw_set_flags(w, YOCTONW_COMPACT);
+	yoctonw_prop(w, "foo", "bar");
+	yoctonw_prop(w, "baz", "qux quux");
+	yoctonw_subobject(w, "subobj");
+	yoctonw_int(w, "value", 1);
+	yoctonw_subobject(w, "x");
+	yoctonw_end(w);
+	yoctonw_bool(w, "y", 0);
+	yoctonw_end(w);
+	yoctonw_base64(w, "data", "abc", 3);
+	yoctonw_prop(w, "end", "end");
+	success = check_output("test_compact", &out,
+		"foo:bar baz:\"qux quux\"subobj{value:1 x{}y:false}"
+		"data:\"YWJj\"end:end");
+	yoctonw_free(w);
+	free(out.data);
+
+	// Compact and normal output should read back the same.
+	w = new_writer(&out);
+	write_mixed_document(w);
+	yoctonw_free(w);
+	w = new_writer(&compact);
+	yoctonw_set_flags(w, YOCTONW_COMPACT);
+	write_mixed_document(w);
+	yoctonw_free(w);
+
+	memset(&digest1, 0, sizeof(digest1));
+	memset(&digest2, 0, sizeof(digest2));
+	obj = read_output(&in, &out);
+	digest_obj(&digest1, obj);
+	success = check_parse_error("test_compact", obj) && success;
+	yocton_free(obj);
+	obj = read_output(&in, &compact);
+	digest_obj(&digest2, obj);
+	success = check_parse_error("test_compact", obj) && success;
+	yocton_free(obj);
+
+	if (compact.len >= out.len) {
+		fprintf(stderr, "test_compact: compact output not smaller\n");
+		success = 0;
+	}
+	success = check_output("test_compact", &digest2, digest1.data)
+	       && success;
+	free(out.data);
+	free(compact.data);
+	free(digest1.data);
+	free(digest2.data);
+	return success;
+}
+
+#define NUM_CHILDREN 8
+
+static void write_section(struct yoctonw_writer *w, int n)
+{
+	int i;
+
+	for (i = 0; i < 50; ++i) {
+		yoctonw_int(w, "value", n * 1000 + i);
+		yoctonw_subobject(w, "sub");
+		yoctonw_prop(w, "name", "a quoted value");
+		yoctonw_end(w);
+	}
+}
+
+struct child_data {
+	struct yoctonw_writer *w;
+	int n;
+};
+
+static void *child_thread(void *arg)
+{
+	struct child_data *data = (struct child_data *) arg;
+	write_section(data->w, data->n);
+	// Ending the parent's subobject is not allowed from the child:
+	yoctonw_end(data->w);
+	return NULL;
+}
+
+// The threaded tests cannot run at all without their threads.
+static void start_thread(pthread_t *thread, void *(*fn)(void *), void *arg)
+{
+	if (pthread_create(thread, NULL, fn, arg) != 0) {
+		fprintf(stderr, "failed to create thread\n");
+		exit(1);
+	}
+}
+
+static int test_children(void)
+{
+	pthread_t threads[NUM_CHILDREN];
+	struct child_data children[NUM_CHILDREN];
+	struct yoctonw_writer *w;
+	struct output out, expected;
+	unsigned int flags;
+	int i, success = 1;
+
+	for (flags = 0; flags <= YOCTONW_COMPACT; ++flags) {
+		w = new_writer(&expected);
+		yoctonw_set_flags(w, flags);
+		yoctonw_prop(w, "before", "x");
+		yoctonw_subobject(w, "section");
+		for (i = 0; i < NUM_CHILDREN; ++i) {
+			write_section(w, i);
+		}
+		yoctonw_end(w);
+		yoctonw_prop(w, "after", "x");
+		yoctonw_free(w);
+
+		w = new_writer(&out);
+		yoctonw_set_flags(w, flags);
+		yoctonw_prop(w, "before", "x");
+		yoctonw_subobject(w, "section");
+		for (i = 0; i < NUM_CHILDREN; ++i) {
+			children[i].w = yoctonw_child(w);
+			children[i].n = i;
+			assert(children[i].w != NULL);
+			start_thread(&threads[i], child_thread, &children[i]);
+		}
+		for (i = 0; i < NUM_CHILDREN; ++i) {
+			pthread_join(threads[i], NULL);
+			yoctonw_splice(w, children[i].w);
+		}
+		yoctonw_end(w);
+		yoctonw_prop(w, "after", "x");
+		if (yoctonw_have_error(w)) {
+			fprintf(stderr, "test_children: unexpected error\n");
+			success = 0;
+		}
+		yoctonw_free(w);
+
+		success = check_output("test_children", &out, expected.data)
+		       && success;
+		free(out.data);
+		free(expected.data);
+	}
+	return success;
+}
+
+static void write_fragment_doc(struct yoctonw_writer *w,
+                               const struct yoctonw_fragment *f)
+{
+	yoctonw_prop(w, "before", "x");
+	if (f != NULL) {
+		yoctonw_raw_fragment(w, f);
+	} else {
+		write_section(w, 1);
+	}
+	yoctonw_subobject(w, "outer");
+	yoctonw_subobject(w, "inner");
+	if (f != NULL) {
+		yoctonw_raw_fragment(w, f);
+		yoctonw_raw_fragment(w, f);
+	} else {
+		write_section(w, 1);
+		write_section(w, 1);
+	}
+	yoctonw_end(w);
+	yoctonw_end(w);
+	yoctonw_prop(w, "after", "x");
+}
+
+static int test_fragments(void)
+{
+	struct yoctonw_writer *w;
+	struct yoctonw_fragment *f;
+	struct output out, expected;
+	unsigned int flags;
+	int success = 1;
+
+	for (flags = 0; flags <= YOCTONW_COMPACT; ++flags) {
+		w = yoctonw_fragment_builder();
+		assert(w != NULL);
+		yoctonw_set_flags(w, flags);
+		write_section(w, 1);
+		f = yoctonw_fragment_finish(w);
+		assert(f != NULL);
+
+		w = new_writer(&expected);
+		yoctonw_set_flags(w, flags);
+		write_fragment_doc(w, NULL);
+		yoctonw_free(w);
+
+		w = new_writer(&out);
+		yoctonw_set_flags(w, flags);
+		write_fragment_doc(w, f);
+		if (yoctonw_have_error(w)) {
+			fprintf(stderr, "test_fragments: unexpected error\n");
+			success = 0;
+		}
+		yoctonw_free(w);
+		yoctonw_fragment_free(f);
+
+		success = check_output("test_fragments", &out, expected.data)
+		       && success;
+		free(out.data);
+		free(expected.data);
+	}
+
+	// A normal fragment still needs separating from a compact value.
+	w = yoctonw_fragment_builder();
+	assert(w != NULL);
+	yoctonw_int(w, "b", 2);
+	f = yoctonw_fragment_finish(w);
+	assert(f != NULL);
+	w = new_writer(&out);
+	yoctonw_set_flags(w, YOCTONW_COMPACT);
+	yoctonw_int(w, "a", 1);
+	yoctonw_raw_fragment(w, f);
+	yoctonw_int(w, "c", 3);
+	yoctonw_free(w);
+	yoctonw_fragment_free(f);
+	success = check_output("test_fragments", &out, "a:1 b: 2\nc:3")
+	       && success;
+	free(out.data);
+
+	// A compact fragment cannot be added to normal output.
+	w = yoctonw_fragment_builder();
+	assert(w != NULL);
+	yoctonw_set_flags(w, YOCTONW_COMPACT);
+	yoctonw_int(w, "b", 2);
+	f = yoctonw_fragment_finish(w);
+	assert(f != NULL);
+	w = new_writer(&out);
+	yoctonw_int(w, "a", 1);
+	yoctonw_raw_fragment(w, f);
+	if (!yoctonw_have_error(w)) {
+		fprintf(stderr, "test_fragments: compact fragment accepted "
+		        "by normal writer\n");
+		success = 0;
+	}
+	yoctonw_free(w);
+	yoctonw_fragment_free(f);
+	free(out.data);
+
+	// Fragments must not leave subobjects open.
+	w = yoctonw_fragment_builder();
+	assert(w != NULL);
+	yoctonw_subobject(w, "unfinished");
+	if (yoctonw_fragment_finish(w) != NULL) {
+		fprintf(stderr, "test_fragments: unbalanced fragment "
+		        "not rejected\n");
+		success = 0;
+	}
+	return success;
+}
+
+static const char copy_input[] =
+	"a: \"x\\ty\" & \"z\"  // trailing\n"
+	"obj {\n"
+	"\tb: c\n"
+	"\t// comment\n"
+	"\tinner {\n"
+	"\t\td: \"e\"\n"
+	"\t}\n"
+	"}\n";
+
+static const char comment_input[] =
+	"url: \"a/b\"\n"
+	"x: \"c\" // d\n"
+	"y: \"e\"\n";
+
+// Read the given input and copy it to a new writer. If wrap is non-zero,
+// everything is copied inside a subobject; if it is negative, only the
+// contents of the first subobject are copied.
+static int copy_document(struct output *out, const char *data, size_t len,
+                         unsigned int flags, int wrap)
+{
+	struct yoctonw_writer *w;
+	struct yocton_object *root, *obj;
+	struct yocton_prop *p;
+	struct input in;
+	int success = 1;
+
+	in.data = data;
+	in.len = len;
+	in.offset = 0;
+	root = obj = yocton_read_with(read_from_input, &in);
+	assert(obj != NULL);
+	w = new_writer(out);
+	yoctonw_set_flags(w, flags);
+	if (wrap > 0) {
+		yoctonw_subobject(w, "wrap");
+	}
+	while ((p = yocton_next_prop(obj)) != NULL) {
+		if (wrap < 0 && yocton_prop_type(p) == YOCTON_PROP_OBJECT) {
+			obj = yocton_prop_inner(p);
+			wrap = 0;
+			continue;
+		}
+		if (wrap >= 0) {
+			yoctonw_copy(w, p);
+		}
+	}
+	yoctonw_end(w);
+	if (yoctonw_have_error(w)) {
+		fprintf(stderr, "test_copy: unexpected error\n");
+		success = 0;
+	}
+	yoctonw_free(w);
+	success = check_parse_error("test_copy", root) && success;
+	yocton_free(root);
+	return success;
+}
+
+static int test_copy(void)
+{
+	struct yoctonw_writer *w;
+	struct yocton_object *obj;
+	struct output out, copy, digest1, digest2;
+	struct input in;
+	int success;
+
+	// Output from the writer is copied unchanged.
+	w = new_writer(&out);
+	write_mixed_document(w);
+	yoctonw_free(w);
+	success = copy_document(&copy, out.data, out.len, 0, 0);
+	success = check_output("test_copy", &copy, out.data) && success;
+	free(copy.data);
+	free(out.data);
+
+	success = copy_document(&copy, copy_input, strlen(copy_input), 0, 1)
+	       && success;
+	success = check_output("test_copy", &copy,
+		"wrap {\n"
+		"\ta: \"x\\ty\" & \"z\"  // trailing\n"
+		"\tobj {\n"
+		"\t\tb: c\n"
+		"\t\t// comment\n"
+		"\t\tinner {\n"
+		"\t\t\td: \"e\"\n"
+		"\t\t}\n"
+		"\t}\n"
+		"}\n") && success;
+	free(copy.data);
+
+	success = copy_document(&copy, copy_input, strlen(copy_input), 0, -1)
+	       && success;
+	success = check_output("test_copy", &copy,
+		"b: c\n"
+		"inner {\n"
+		"\td: \"e\"\n"
+		"}\n") && success;
+	free(copy.data);
+
+	// Compact output must read back the same as the input.
+	success = copy_document(&copy, copy_input, strlen(copy_input),
+	                        YOCTONW_COMPACT, 0) && success;
+	memset(&out, 0, sizeof(out));
+	write_to_output((void *) copy_input, strlen(copy_input), &out);
+	memset(&digest1, 0, sizeof(digest1));
+	memset(&digest2, 0, sizeof(digest2));
+	obj = read_output(&in, &out);
+	digest_obj(&digest1, obj);
+	yocton_free(obj);
+	obj = read_output(&in, &copy);
+	digest_obj(&digest2, obj);
+	success = check_parse_error("test_copy", obj) && success;
+	yocton_free(obj);
+	success = check_output("test_copy", &digest2, digest1.data)
+	       && success;
+	free(out.data);
+	free(copy.data);
+	free(digest1.data);
+	free(digest2.data);
+
+	// Only a real comment needs ending with a newline.
+	success = copy_document(&copy, comment_input, strlen(comment_input),
+	                        YOCTONW_COMPACT, 0) && success;
+	success = check_output("test_copy", &copy,
+		"url:\"a/b\"x:\"c\" // d\ny:\"e\"") && success;
+	free(copy.data);
+
+	return success;
+}
+
+struct thread_output {
+	struct output out;
+	pthread_t caller;
+	int other_thread;
+};
+
+static int write_from_thread(void *buf, size_t nbytes, void *handle)
+{
+	struct thread_output *t = (struct thread_output *) handle;
+
+	if (!pthread_equal(pthread_self(), t->caller)) {
+		t->other_thread = 1;
+	}
+	return write_to_output(buf, nbytes, &t->out);
+}
+
+static int test_async(void)
+{
+	struct yoctonw_writer *w;
+	struct yoctonw_async *a;
+	struct output expected;
+	struct thread_output t;
+	unsigned int num_buffers;
+	int i, success = 1;
+
+	w = new_writer(&expected);
+	for (i = 0; i < 20; ++i) {
+		write_mixed_document(w);
+	}
+	yoctonw_free(w);
+
+	for (num_buffers = 2; num_buffers <= 3; ++num_buffers) {
+		memset(&t, 0, sizeof(t));
+		t.caller = pthread_self();
+		// Small buffers, so that the writer has to wait for them.
+		a = yoctonw_async_new(write_from_thread, &t, num_buffers, 100);
+		assert(a != NULL);
+		w = yoctonw_write_with(yoctonw_async_write, a);
+		for (i = 0; i < 20; ++i) {
+			write_mixed_document(w);
+		}
+		yoctonw_free(w);
+		if (!yoctonw_async_finish(a)) {
+			fprintf(stderr, "test_async: unexpected error\n");
+			success = 0;
+		}
+		yoctonw_async_free(a);
+		if (!t.other_thread) {
+			fprintf(stderr, "test_async: callback not invoked "
+			        "from background thread\n");
+			success = 0;
+		}
+		success = check_output("test_async", &t.out, expected.data)
+		       && success;
+		free(t.out.data);
+	}
+	free(expected.data);
+
+	// Errors are reported to the writer on a later flush.
+	a = yoctonw_async_new(fail_write, NULL, 0, 100);
+	assert(a != NULL);
+	w = yoctonw_write_with(yoctonw_async_write, a);
+	for (i = 0; i < 20 && !yoctonw_have_error(w); ++i) {
+		write_mixed_document(w);
+	}
+	if (!yoctonw_have_error(w)) {
+		fprintf(stderr, "test_async: error not reported to writer\n");
+		success = 0;
+	}
+	yoctonw_free(w);
+	if (yoctonw_async_finish(a)) {
+		fprintf(stderr, "test_async: error not reported\n");
+		success = 0;
+	}
+	yoctonw_async_free(a);
+	return success;
+}
+
+#define NUM_RING_RECORDS 10000
+
+struct ring_reader {
+	struct yoctonw_ring *ring;
+	struct output out;
+	int done;
+};
+
+static void drain_ring(struct ring_reader *r)
+{
+	char buf[100];
+	size_t len;
+
+	while ((len = yoctonw_ring_read(r->ring, buf, sizeof(buf))) > 0) {
+		write_to_output(buf, len, &r->out);
+	}
+}
+
+static void *ring_reader_thread(void *arg)
+{
+	struct ring_reader *r = (struct ring_reader *) arg;
+
+	while (!__atomic_load_n(&r->done, __ATOMIC_ACQUIRE)) {
+		drain_ring(r);
+	}
+	drain_ring(r);
+	return NULL;
+}
+
+static void write_ring_record(struct yoctonw_writer *w, int i)
+{
+	yoctonw_subobject(w, "record");
+	yoctonw_int(w, "id", i);
+	yoctonw_double(w, "ratio", i / 3.0);
+	yoctonw_prop(w, "name", "a quoted value");
+	yoctonw_end(w);
+}
+
+static int test_ring(void)
+{
+	static uint8_t ring_data[1024], writer_mem[4096];
+	struct yoctonw_ring ring;
+	struct yoctonw_writer *w;
+	struct yocton_object *obj;
+	struct yocton_prop *p;
+	struct output expected;
+	struct ring_reader r;
+	struct input in;
+	pthread_t thread;
+	char long_value[2000];
+	size_t count;
+	int i, success = 1;
+
+	yoctonw_ring_init(&ring, ring_data, sizeof(ring_data));
+	w = yoctonw_write_to_ring(&ring, writer_mem, sizeof(writer_mem));
+	assert(w != NULL);
+	memset(&r, 0, sizeof(r));
+	r.ring = &ring;
+
+	// Records that are too big, or use yoctonw_printf, are dropped.
+	write_ring_record(w, 1);
+	memset(long_value, 'x', sizeof(long_value) - 1);
+	long_value[sizeof(long_value) - 1] = '\0';
+	yoctonw_subobject(w, "too_big");
+	for (i = 0; i < 3; ++i) {
+		yoctonw_prop(w, "value", long_value);
+	}
+	yoctonw_end(w);
+	yoctonw_printf(w, "printf", "%d", 1234);
+	write_ring_record(w, 2);
+	drain_ring(&r);
+	w = new_writer(&expected);
+	write_ring_record(w, 1);
+	write_ring_record(w, 2);
+	yoctonw_free(w);
+	success = check_output("test_ring", &r.out, expected.data);
+	if (yoctonw_ring_dropped(&ring) != 2) {
+		fprintf(stderr, "test_ring: want 2 dropped records, got %d\n",
+		        (int) yoctonw_ring_dropped(&ring));
+		success = 0;
+	}
+	free(expected.data);
+	free(r.out.data);
+
+	// Read from another thread while writing. Some records may be
+	// dropped, but the reader must only see whole records.
+	yoctonw_ring_init(&ring, ring_data, sizeof(ring_data));
+	w = yoctonw_write_to_ring(&ring, writer_mem, sizeof(writer_mem));
+	memset(&r, 0, sizeof(r));
+	r.ring = &ring;
+	start_thread(&thread, ring_reader_thread, &r);
+	for (i = 0; i < NUM_RING_RECORDS; ++i) {
+		write_ring_record(w, i);
+	}
+	__atomic_store_n(&r.done, 1, __ATOMIC_RELEASE);
+	pthread_join(thread, NULL);
+
+	obj = read_output(&in, &r.out);
+	count = 0;
+	while ((p = yocton_next_prop(obj)) != NULL) {
+		if (strcmp(yocton_prop_name(p), "record") != 0) {
+			fprintf(stderr, "test_ring: wrong property %s\n",
+			        yocton_prop_name(p));
+			success = 0;
+		}
+		++count;
+	}
+	success = check_parse_error("test_ring", obj) && success;
+	yocton_free(obj);
+	if (count + yoctonw_ring_dropped(&ring) != NUM_RING_RECORDS) {
+		fprintf(stderr, "test_ring: %d records read, %d dropped\n",
+		        (int) count, (int) yoctonw_ring_dropped(&ring));
+		success = 0;
+	}
+	free(r.out.data);
+
+	// A zero-sized ring drops everything.
+	yoctonw_ring_init(&ring, ring_data, 0);
+	w = yoctonw_write_to_ring(&ring, writer_mem, sizeof(writer_mem));
+	write_ring_record(w, 1);
+	if (yoctonw_ring_read(&ring, ring_data, sizeof(ring_data)) != 0
+	 || yoctonw_ring_dropped(&ring) != 1) {
+		fprintf(stderr, "test_ring: zero-sized ring not empty\n");
+		success = 0;
+	}
+	return success;
+}
+
+#define NUM_MUX_THREADS 8
+#define NUM_MUX_RECORDS 200
+
+struct mux_thread {
+	struct yoctonw_mux *mux;
+	unsigned int flags;
+	int n;
+};
+
+static void *mux_thread(void *arg)
+{
+	struct mux_thread *t = (struct mux_thread *) arg;
+	struct yoctonw_writer *w;
+	char value[600];
+	int i;
+
+	// Long enough that records are bigger than the writer's buffer.
+	memset(value, 'a' + t->n, sizeof(value) - 1);
+	value[sizeof(value) - 1] = '\0';
+	w = yoctonw_mux_writer(t->mux);
+	assert(w != NULL);
+	yoctonw_set_flags(w, t->flags);
+	for (i = 0; i < NUM_MUX_RECORDS; ++i) {
+		yoctonw_subobject(w, "record");
+		yoctonw_int(w, "thread", t->n);
+		yoctonw_int(w, "seq", i);
+		yoctonw_prop(w, "value", value);
+		yoctonw_end(w);
+		yoctonw_int(w, "bare", t->n);
+	}
+	yoctonw_free(w);
+	return NULL;
+}
+
+// Check that the output of test_mux is whole records, in order for each
+// thread.
+static int check_mux_output(struct output *out)
+{
+	struct yocton_object *obj, *inner;
+	struct yocton_prop *p, *p2;
+	struct input in;
+	int next_seq[NUM_MUX_THREADS], thread, seq, i, success = 1;
+	char value[600];
+
+	memset(next_seq, 0, sizeof(next_seq));
+	obj = read_output(&in, out);
+	while ((p = yocton_next_prop(obj)) != NULL) {
+		if (strcmp(yocton_prop_name(p), "bare") == 0) {
+			continue;
+		}
+		inner = yocton_prop_inner(p);
+		p2 = yocton_next_prop(inner);
+		thread = p2 != NULL ? (int) yocton_prop_int(p2, 4) : -1;
+		p2 = yocton_next_prop(inner);
+		seq = p2 != NULL ? (int) yocton_prop_int(p2, 4) : -1;
+		p2 = yocton_next_prop(inner);
+		if (thread < 0 || thread >= NUM_MUX_THREADS || p2 == NULL
+		 || seq != next_seq[thread]) {
+			fprintf(stderr, "test_mux: record out of order\n");
+			success = 0;
+			break;
+		}
+		memset(value, 'a' + thread, sizeof(value) - 1);
+		value[sizeof(value) - 1] = '\0';
+		if (strcmp(yocton_prop_value(p2), value) != 0) {
+			fprintf(stderr, "test_mux: wrong value\n");
+			success = 0;
+		}
+		++next_seq[thread];
+	}
+	success = check_parse_error("test_mux", obj) && success;
+	yocton_free(obj);
+	for (i = 0; i < NUM_MUX_THREADS; ++i) {
+		if (next_seq[i] != NUM_MUX_RECORDS) {
+			fprintf(stderr, "test_mux: thread %d: %d records\n",
+			        i, next_seq[i]);
+			success = 0;
+		}
+	}
+	return success;
+}
+
+static int test_mux(void)
+{
+	pthread_t threads[NUM_MUX_THREADS];
+	struct mux_thread data[NUM_MUX_THREADS];
+	struct yoctonw_mux *mux;
+	struct output out;
+	unsigned int flags;
+	size_t buffer_size;
+	int i, success = 1;
+
+	for (flags = 0; flags <= YOCTONW_COMPACT; ++flags) {
+		for (buffer_size = 0; buffer_size <= 4096;
+		     buffer_size += 4096) {
+			memset(&out, 0, sizeof(out));
+			mux = yoctonw_mux_new(write_to_output, &out,
+			                      buffer_size);
+			assert(mux != NULL);
+			for (i = 0; i < NUM_MUX_THREADS; ++i) {
+				data[i].mux = mux;
+				data[i].flags = flags;
+				data[i].n = i;
+				start_thread(&threads[i], mux_thread,
+				             &data[i]);
+			}
+			for (i = 0; i < NUM_MUX_THREADS; ++i) {
+				pthread_join(threads[i], NULL);
+			}
+			success = yoctonw_mux_free(mux) && success;
+			success = check_mux_output(&out) && success;
+			free(out.data);
+		}
+	}
+	return success;
+}
+
+struct slow_sink {
+	struct output out;
+	int started, released, timed_out;
+};
+
+// Write callback that waits for the test to release it, to check that
+// writers are not held up while output is written.
+static int slow_write(void *buf, size_t nbytes, void *handle)
+{
+	struct slow_sink *s = (struct slow_sink *) handle;
+	struct timespec delay = {0, 1000000};
+	int i;
+
+	__atomic_store_n(&s->started, 1, __ATOMIC_RELEASE);
+	for (i = 0; !__atomic_load_n(&s->released, __ATOMIC_ACQUIRE); ++i) {
+		if (i >= 5000) {
+			s->timed_out = 1;
+			break;
+		}
+		nanosleep(&delay, NULL);
+	}
+	return write_to_output(buf, nbytes, &s->out);
+}
+
+static void *slow_sink_thread(void *arg)
+{
+	struct yoctonw_writer *w = yoctonw_mux_writer(
+		(struct yoctonw_mux *) arg);
+
+	assert(w != NULL);
+	yoctonw_prop(w, "a", "0123456789");
+	// Does not fit in the buffer, so the first record is written.
+	yoctonw_prop(w, "b", "1");
+	yoctonw_free(w);
+	return NULL;
+}
+
+static int test_mux_slow_sink(void)
+{
+	struct yoctonw_mux *mux;
+	struct yoctonw_writer *w;
+	struct slow_sink s;
+	pthread_t thread;
+	struct timespec delay = {0, 1000000};
+	int success = 1;
+
+	memset(&s, 0, sizeof(s));
+	mux = yoctonw_mux_new(slow_write, &s, 16);
+	assert(mux != NULL);
+	start_thread(&thread, slow_sink_thread, mux);
+	while (!__atomic_load_n(&s.started, __ATOMIC_ACQUIRE)) {
+		nanosleep(&delay, NULL);
+	}
+	// The other thread is stuck writing, but there is room in the
+	// buffer, so this does not have to wait for it.
+	w = yoctonw_mux_writer(mux);
+	assert(w != NULL);
+	yoctonw_prop(w, "c", "2");
+	yoctonw_free(w);
+	__atomic_store_n(&s.released, 1, __ATOMIC_RELEASE);
+	pthread_join(thread, NULL);
+	success = yoctonw_mux_free(mux) && success;
+
+	if (s.timed_out) {
+		fprintf(stderr, "test_mux_slow_sink: writer waited for "
+		        "output to be written\n");
+		success = 0;
+	}
+	success = check_output("test_mux_slow_sink", &s.out,
+		"a: 0123456789\n"
+		"b: 1\n"
+		"c: 2\n") && success;
+	free(s.out.data);
+	return success;
+}
+
+static int test_reset(void)
+{
+	struct yoctonw_writer *w;
+	struct output out1, out2, out3;
+	char *buf;
+	int success;
+
+	memset(&out1, 0, sizeof(out1));
+	memset(&out2, 0, sizeof(out2));
+	memset(&out3, 0, sizeof(out3));
+
+	// Unfinished output goes to the old callback.
+	w = yoctonw_write_with(write_to_output, &out1);
+	assert(w != NULL);
+	yoctonw_set_flush_policy(w, YOCTONW_FLUSH_EXPLICIT, 0);
+	yoctonw_prop(w, "first", "document");
+	yoctonw_subobject(w, "unfinished");
+	success = yoctonw_reset(w, write_to_output, &out2);
+	yoctonw_printf(w, "second", "%s", "document");
+	yoctonw_subobject(w, "finished");
+	yoctonw_end(w);
+
+	// A failed write to the old callback is reported, and the error is
+	// cleared.
+	success = yoctonw_reset(w, fail_write, NULL) && success;
+	yoctonw_prop(w, "failed", "document");
+	if (yoctonw_reset(w, write_to_output, &out3)) {
+		fprintf(stderr, "test_reset: failed write not reported\n");
+		success = 0;
+	}
+	yoctonw_prop(w, "third", "document");
+	if (yoctonw_have_error(w)) {
+		fprintf(stderr, "test_reset: error not cleared\n");
+		success = 0;
+	}
+	yoctonw_free(w);
+
+	success = check_output("test_reset", &out1,
+		"first: document\n"
+		"unfinished {\n") && success;
+	success = check_output("test_reset", &out2,
+		"second: document\n"
+		"finished {\n"
+		"}\n") && success;
+	success = check_output("test_reset", &out3,
+		"third: document\n") && success;
+	free(out1.data);
+	free(out2.data);
+	free(out3.data);
+
+	// An in-memory writer can be reused after its buffer is taken.
+	w = yoctonw_write_to_buffer();
+	assert(w != NULL);
+	yoctonw_prop(w, "in", "memory");
+	free(yoctonw_take_buffer(w, NULL));
+	memset(&out1, 0, sizeof(out1));
+	success = yoctonw_reset(w, write_to_output, &out1) && success;
+	yoctonw_prop(w, "to", "callback");
+	success = yoctonw_reset(w, NULL, NULL) && success;
+	yoctonw_prop(w, "back", "to memory");
+	buf = yoctonw_take_buffer(w, NULL);
+	success = check_output("test_reset", &out1, "to: callback\n")
+	       && success;
+	if (buf == NULL || strcmp(buf, "back: \"to memory\"\n") != 0) {
+		fprintf(stderr, "test_reset: wrong in-memory output\n");
+		success = 0;
+	}
+	free(buf);
+	free(out1.data);
+
+	// Output that has not been taken from an in-memory writer is not
+	// thrown away.
+	yoctonw_prop(w, "not", "taken");
+	if (yoctonw_reset(w, write_to_output, &out1)) {
+		fprintf(stderr, "test_reset: in-memory output discarded\n");
+		success = 0;
+	}
+	buf = yoctonw_take_buffer(w, NULL);
+	if (buf == NULL || strcmp(buf, "not: taken\n") != 0) {
+		fprintf(stderr, "test_reset: in-memory output lost\n");
+		success = 0;
+	}
+	free(buf);
+	yoctonw_free(w);
+
+	// Nor is an unfinished record with YOCTONW_FLUSH_RECORD.
+	memset(&out1, 0, sizeof(out1));
+	w = yoctonw_write_with(write_to_output, &out1);
+	assert(w != NULL);
+	yoctonw_set_flush_policy(w, YOCTONW_FLUSH_RECORD, 0);
+	yoctonw_subobject(w, "record");
+	yoctonw_prop(w, "name", "value");
+	if (yoctonw_reset(w, write_to_output, &out2)) {
+		fprintf(stderr, "test_reset: unfinished record discarded\n");
+		success = 0;
+	}
+	yoctonw_end(w);
+	yoctonw_free(w);
+	success = check_output("test_reset", &out1,
+		"record {\n"
+		"\tname: value\n"
+		"}\n") && success;
+	free(out1.data);
+
+	// After an error, output that cannot be flushed is discarded so that
+	// the writer can still be reused.
+	memset(&out1, 0, sizeof(out1));
+	w = yoctonw_write_to_buffer();
+	assert(w != NULL);
+	yoctonw_prop_n(w, "a", 1, "x\0y", 3);
+	if (yoctonw_reset(w, NULL, NULL)) {
+		fprintf(stderr, "test_reset: in-memory error not reported\n");
+		success = 0;
+	}
+	yoctonw_set_flush_policy(w, YOCTONW_FLUSH_RECORD, 0);
+	success = yoctonw_reset(w, write_to_output, &out1) && success;
+	yoctonw_subobject(w, "record");
+	yoctonw_prop_n(w, "a", 1, "x\0y", 3);
+	if (yoctonw_reset(w, write_to_output, &out1)) {
+		fprintf(stderr, "test_reset: record error not reported\n");
+		success = 0;
+	}
+	yoctonw_prop(w, "after", "error");
+	yoctonw_free(w);
+	success = check_output("test_reset", &out1, "after: error\n")
+	       && success;
+	free(out1.data);
+
+	// A writev writer can be reset to another writev callback.
+	memset(&out1, 0, sizeof(out1));
+	memset(&out2, 0, sizeof(out2));
+	w = yoctonw_writev_with(writev_to_output, &out1);
+	assert(w != NULL);
+	yoctonw_prop(w, "first", "document");
+	success = yoctonw_reset_writev(w, writev_to_output, &out2) && success;
+	yoctonw_prop(w, "second", "document");
+	yoctonw_free(w);
+	success = check_output("test_reset", &out1, "first: document\n")
+	       && success;
+	success = check_output("test_reset", &out2, "second: document\n")
+	       && success;
+	if (out2.max_iovcnt == 0) {
+		fprintf(stderr, "test_reset: writev callback not used\n");
+		success = 0;
+	}
+	free(out1.data);
+	free(out2.data);
+	return success;
+}
+
+static int test_write_error(void)
+{
+	struct yoctonw_writer *w;
+	int success = 1;
+
+	w = yoctonw_write_with(fail_write, NULL);
+	assert(w != NULL);
+	yoctonw_prop(w, "name", "value");
+	if (!yoctonw_have_error(w)) {
+		fprintf(stderr, "test_write_error: error not reported\n");
+		success = 0;
+	}
+	yoctonw_free(w);
+	return success;
+}
+
+static int (*tests[])(void) = {
+	test_basic,
+	test_lengths,
+	test_numbers,
+	test_escapes,
+	test_long_strings,
+	test_deep_nesting,
+	test_base64,
+	test_flush_policy,
+	test_writev,
+	test_write_to_buffer,
+	test_measure,
+	test_compact,
+	test_children,
+	test_fragments,
+	test_copy,
+	test_async,
+	test_ring,
+	test_mux,
+	test_mux_slow_sink,
+	test_reset,
+	test_write_error,
+	NULL,
+};
+
+int main(int argc, char *argv[])
+{
+	int i;
+	int success = 1;
+
+	for (i = 0; tests[i] != NULL; i++) {
+		success = tests[i]() && success;
+	}
+
+	exit(!success);
+	return 0;
+}